@@ -0,0 +1,75 @@
+#include "Common.h"
+
+#pragma once
+
+namespace arx65::cpu
+{
+	template <bool DECODED> struct ContextT;
+	typedef ContextT<true> DecodedContext;
+
+	/* One instruction decoded ahead of time. The handler takes its operand from the op instead of
+	   fetching it through the bus. */
+	typedef struct {
+		int (*handler)(DecodedContext &context);
+		uint16_t operand;
+		uint8_t opcode;
+		uint8_t length;
+	} DecodedOp;
+
+	/* Straight-line code starting at one address, ending with the first instruction that can
+	   change the flow of the program (branch, jump, call, return or BRK). */
+	typedef struct {
+		uint16_t start, end;
+		std::vector<DecodedOp> ops;
+
+		// Times the block was entered, so the JIT core can tell which blocks are hot
+		unsigned int executions = 0;
+
+		// Native code for the block once the JIT core has compiled it
+		void *native = nullptr;
+	} Block;
+
+	/* Decoded blocks keyed by their start address. Writing to a page that holds cached code
+	   throws away every block touching that page, so self-modifying code still works. */
+	class BlockCache
+	{
+	private:
+		// Blocks by start address, one table of 256 entries per page, allocated on first use
+		Block **entries[256];
+
+		// Every block overlapping each page, so invalidating a page can find them
+		std::vector<Block *> overlapping[256];
+
+		// Invalidated blocks that may still be executing, freed by collect()
+		std::vector<Block *> retired;
+
+	public:
+		// Nonzero for each page holding cached code. Checked by the CPU on every write.
+		uint8_t codePage[256];
+
+		// Incremented whenever blocks are invalidated, so the core knows to leave the current block
+		unsigned int generation;
+
+		BlockCache();
+		~BlockCache();
+
+		Block *find(uint16_t address)
+		{
+			Block **page = entries[address >> 8];
+			return page ? page[address & 0xFF] : nullptr;
+		}
+
+		// Take ownership of a decoded block for an address find() returned nullptr for.
+		// The block must not wrap around the end of memory.
+		void insert(Block *block);
+
+		// Drop every block that has code in this page
+		void invalidatePage(uint8_t page);
+
+		// Drop everything, used when memory was changed behind the CPU's back
+		void clear();
+
+		// Free invalidated blocks. Only call when no block is being executed.
+		void collect();
+	};
+}
@@ -4,13 +4,27 @@
 
 namespace arx65::mod
 {
+	/* Backing storage of plain memory, covering addresses start through end. */
+	typedef struct {
+		uint16_t start, end;
+		uint8_t *data;
+		bool writable;
+	} MemorySpan;
+
 	class BusConnection {
 	public:
+		// Devices are deleted through this interface
+		virtual ~BusConnection() = default;
+
 		// Return true if an address is in range of connected device
 		virtual bool isAddressInRange(uint16_t address, bool read) = 0;
 
 		// Read/write to the device, only called if address in range is true.
 		virtual uint8_t read(uint16_t address) = 0;
 		virtual void write(uint16_t address, uint8_t byte) = 0;
+
+		// Optional. Devices that are plain memory with no side effects on access can fill in their
+		// storage here, and the bus will load and store straight to it instead of calling read/write.
+		virtual bool getMemorySpan(MemorySpan &) { return false; }
 	};
 }
@@ -7,11 +7,15 @@
 #include <ctime>
 #include <cmath>
 #include <string>
+#include <sstream>
 #include <cstring>
 #include <fstream>
 #include <map>
-
-#include <SDL2/SDL.h>
-#include <SDL2/SDL_image.h>
+#include <algorithm>
+#include <numeric>
+#include <functional>
+#include <climits>
+#include <atomic>
+#include <thread>
 
 #define HEX(x, prin) std::setfill('0') << std::setw(x) << std::right << std::uppercase << std::hex << (int)prin << std::nouppercase << std::dec
\ No newline at end of file
@@ -6,10 +6,87 @@
 
 namespace arx65::bus
 {
-	uint8_t read(uint16_t address);
-	void write(uint16_t address, uint8_t byte);
-	void attach(arx65::mod::BusConnection *device);
-	void clear();
+	/* The address and data bus of one machine, holding the devices attached to it. */
+	class Bus
+	{
+	private:
+		std::vector<arx65::mod::BusConnection *> connections;
+
+		/* Which device answers reads and writes in each 256 byte page. A page only gets a device if
+		   that device claims every address in it, otherwise it is marked shared and searched per access. */
+		typedef struct {
+			arx65::mod::BusConnection *reader, *writer;
+			bool sharedRead, sharedWrite;
+		} Page;
+
+		Page pages[256];
+
+		/* Backing storage of each page, indexed by the low byte of the address. Only set when the
+		   device owning the whole page is plain memory, so loads and stores can skip the device. */
+		uint8_t *directRead[256];
+		uint8_t *directWrite[256];
+
+		// Bumped by every rebuild of the page map
+		unsigned int mapVersion;
+
+		// Recalculate the page map from the attached devices, called whenever the device list changes
+		void rebuildPageMap();
+
+		// Search the device list for one address, the same way the page map was built
+		arx65::mod::BusConnection *findDevice(uint16_t address, bool read);
+
+		// Slow paths of read and write, going through the page's device
+		uint8_t readDevice(uint16_t address);
+		void writeDevice(uint16_t address, uint8_t byte);
+
+	public:
+		Bus();
+
+		uint8_t read(uint16_t address)
+		{
+			const uint8_t *direct = directRead[address >> 8];
+			if (direct) return direct[address & 0xFF];
+			return readDevice(address);
+		}
+
+		void write(uint16_t address, uint8_t byte)
+		{
+			uint8_t *direct = directWrite[address >> 8];
+			if (direct) direct[address & 0xFF] = byte;
+			else writeDevice(address, byte);
+		}
+
+		// Little endian 16 bit read, as used for operands and vectors. Wraps at the top of memory.
+		uint16_t read16(uint16_t address)
+		{
+			const uint8_t *direct = directRead[address >> 8];
+			if (direct && (address & 0xFF) != 0xFF)
+			{
+				return direct[address & 0xFF] | (direct[(address & 0xFF) + 1] << 8);
+			}
+			return read(address) | (read((uint16_t)(address + 1)) << 8);
+		}
+
+		// True if the page holding address is plain memory that can be read ahead of time
+		bool isDirectRead(uint16_t address)
+		{
+			return directRead[address >> 8] != nullptr;
+		}
+
+		// Storage that can be both loaded and stored directly for every page from start to end, if
+		// those pages are one contiguous block of plain memory. Otherwise nullptr.
+		uint8_t *getDirectRange(uint16_t start, uint16_t end);
+
+		// The direct page tables themselves, for generated code that does the lookup inline
+		uint8_t *const *getDirectReadPages() { return directRead; }
+		uint8_t *const *getDirectWritePages() { return directWrite; }
+
+		// Changes whenever devices are attached or removed, so pointers taken from the page map can be dropped
+		unsigned int getMapVersion() { return mapVersion; }
+
+		void attach(arx65::mod::BusConnection *device);
+		void clear();
+	};
 };
 
 #endif
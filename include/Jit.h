@@ -0,0 +1,145 @@
+#include "Common.h"
+#include "Processor.h"
+
+#pragma once
+
+namespace arx65::cpu
+{
+	/* One access made by a compiled block while the JIT is being checked against the interpreter. */
+	typedef struct {
+		uint16_t address;
+		uint8_t value;
+		uint8_t old;		// Previous contents for writes to plain memory, so they can be undone
+		bool write;
+		bool direct;		// Plain memory rather than a device
+	} JitAccess;
+
+	/* Everything compiled code works on. The generated code addresses the fields by offset. */
+	struct JitState
+	{
+		RegisterSet R;
+
+		// Cycles used by the block
+		int64_t cycles;
+
+		// Ops of the block finished before it returned
+		uint32_t completed;
+
+		// Set when a write invalidated cached code, so the block leaves after the current op
+		uint8_t leave;
+
+		// Scratch space for the generated code
+		uint8_t scratch;
+		uint32_t address;
+
+		// Bus for everything that does not go straight to memory. The logging bus while checking.
+		arx65::bus::Bus *bus;
+		BlockCache *cache;
+
+		// Copy of NZ_FLAGS, kept next to the registers so the generated code reaches it by offset
+		uint8_t nz[256];
+	};
+
+	typedef void (*JitCode)(JitState *state);
+
+	/* Passes every access on to a bus and logs the ones that can not be repeated for free:
+	   writes, and reads of devices. */
+	class JitLogger : public arx65::mod::BusConnection
+	{
+	private:
+		arx65::bus::Bus *target;
+
+	public:
+		std::vector<JitAccess> log;
+
+		JitLogger(arx65::bus::Bus *target);
+
+		bool isAddressInRange(uint16_t address, bool read) override;
+		uint8_t read(uint16_t address) override;
+		void write(uint16_t address, uint8_t byte) override;
+	};
+
+	/* Bus for running the interpreter over code the JIT already ran. Memory is read as it was
+	   before the block, devices answer with what they gave the compiled code, and writes are
+	   only collected. */
+	class JitReplay : public arx65::mod::BusConnection
+	{
+	private:
+		arx65::bus::Bus *target;
+		const std::vector<JitAccess> &log;
+		size_t nextRead;
+		std::map<uint16_t, uint8_t> written;
+
+	public:
+		std::vector<JitAccess> writes;
+
+		// Set when a device read does not line up with the log
+		bool diverged;
+
+		JitReplay(arx65::bus::Bus *target, const std::vector<JitAccess> &log);
+
+		// Forget the last replay, before starting the next
+		void reset();
+
+		bool isAddressInRange(uint16_t address, bool read) override;
+		uint8_t read(uint16_t address) override;
+		void write(uint16_t address, uint8_t byte) override;
+	};
+
+	/* Compiles hot blocks of the block cache to native x86-64 code. The emulated registers live in
+	   host registers for the whole block, plain memory is loaded and stored directly, and devices
+	   are reached through the bus. Anything without a native version is handed to the interpreter,
+	   which stays the reference for every instruction. */
+	class Jit
+	{
+	private:
+		arx65::bus::Bus *bus;
+		BlockCache *cache;
+
+		// Executable memory, filled from the start and thrown away as a whole
+		uint8_t *code;
+		size_t capacity, used;
+
+		// Page map the code was generated against, since the code has pointers into it
+		unsigned int mapVersion;
+
+		JitLogger logger;
+		arx65::bus::Bus loggingBus;
+
+		JitReplay replay;
+		arx65::bus::Bus replayBus;
+
+	public:
+		JitState state;
+
+		Jit(arx65::bus::Bus *bus, BlockCache *cache);
+		~Jit();
+
+		// True if this build can generate code for the host it runs on
+		static bool isSupported();
+
+		// Generate code for a block and store it in the block. Returns false when the code space
+		// is full, in which case the cache should be cleared and the code reset.
+		bool compile(Block *block);
+
+		// Throw away all code. Only call while no compiled block is running, after clearing the cache.
+		void reset();
+
+		// True if devices have been attached or removed since the code was generated
+		bool isStale();
+
+		// Route every store and device access through the log, so blocks can be checked against the
+		// interpreter. Only affects code compiled afterwards.
+		void setChecking(bool checking);
+		bool isChecking();
+		std::vector<JitAccess> &getLog();
+
+		// Bus that replays the log for the interpreter, reset for each block checked
+		JitReplay &getReplay();
+		arx65::bus::Bus *getReplayBus();
+	};
+
+	// Run one decoded op through the interpreter on the registers in the state. Compiled code calls
+	// this for everything it has no native version of. Defined with the interpreter.
+	int jitInterpret(JitState *state, const DecodedOp *op);
+}
@@ -1,5 +1,7 @@
 #include "Common.h"
 #include "Databus.h"
+#include "BlockCache.h"
+#include "Scheduler.h"
 
 #pragma once
 
@@ -14,6 +16,19 @@ namespace arx65::cpu
 	const uint8_t FLAG_ZERO = 0x02;
 	const uint8_t FLAG_CARRY = 0x01;
 
+	/* N and Z as set by every possible result byte. Built by the compiler. */
+	struct NZTable
+	{
+		uint8_t flags[256] = {};
+
+		constexpr NZTable()
+		{
+			for (int i = 0; i < 256; i++) flags[i] = (i == 0 ? FLAG_ZERO : 0) | (i & 0x80 ? FLAG_NEGATIVE : 0);
+		}
+	};
+
+	inline constexpr NZTable NZ_FLAGS;
+
 	/* The main register set */
 	typedef struct {
 		uint8_t A;
@@ -24,23 +39,202 @@ namespace arx65::cpu
 		uint16_t PC;
 	} RegisterSet;
 
-	RegisterSet *getRegisters();
-	RegisterSet getRegistersCopy();
+	/* Addressing modes. Every legal opcode is one operation specialized for one of these, which
+	   decides its length, how the operand is found and what it costs in cycles. */
+	enum Mode {
+		MODE_IMPLIED,
+		MODE_ACCUMULATOR,
+		MODE_IMMEDIATE,
+		MODE_ZP,
+		MODE_ZPX,
+		MODE_ZPY,
+		MODE_ABSOLUTE,
+		MODE_ABSOLUTEX,
+		MODE_ABSOLUTEY,
+		MODE_INDIRECT,		// JMP only
+		MODE_INDIRECTX,
+		MODE_INDIRECTY,
+		MODE_RELATIVE		// Branches
+	};
+
+	/* What an opcode is, for tools that generate or list 6502 code */
+	typedef struct {
+		const char *name;	// Mnemonic, nullptr for the opcodes that are not legal
+		Mode mode;
+		uint8_t length;		// Bytes, opcode included
+	} OpcodeInfo;
+
+	OpcodeInfo getOpcodeInfo(uint8_t opcode);
+
+	/* Execution cores that doNextInstruction can dispatch through */
+	enum Core {
+		CORE_TABLE,		// Indirect call through the instruction[] function pointer table
+		CORE_SWITCH,	// One switch with every handler inlined into its case
+		CORE_BLOCK,		// Pre-decoded straight-line blocks from the block cache
+		CORE_JIT		// The block core, with hot blocks compiled to native code on x86-64 hosts
+	};
+
+	/* Executions and cycles of every instruction run while a Cpu had this profile set, by the address
+	   it started at and by its opcode. Interrupt entries are not counted. About 1 MB, so allocate it
+	   with new Profile() to get it zeroed. */
+	typedef struct {
+		uint64_t executions[65536];
+		uint64_t cycles[65536];
+		uint64_t opcodeExecutions[256];
+		uint64_t opcodeCycles[256];
+
+		void record(uint16_t pc, uint8_t opcode, long taken)
+		{
+			executions[pc]++;
+			cycles[pc] += taken;
+			opcodeExecutions[opcode]++;
+			opcodeCycles[opcode] += taken;
+		}
+	} Profile;
+
+	class Jit;
+
+	/* A single 6502. Each instance owns its registers and talks only to its own bus, so any
+	   number of independent machines can run on separate threads. */
+	class Cpu
+	{
+	private:
+		arx65::bus::Bus *bus;
+		RegisterSet R;
+
+		// Which core doNextInstruction and the run loop dispatch through
+		Core activeCore;
+
+		// Decoded code for the block core, only allocated while that core is selected
+		BlockCache *blocks;
+
+		// Compiler for the JIT core, only allocated while that core is selected and the host supports it
+		Jit *jit;
+
+		// Check compiled blocks against the interpreter, and how many disagreed so far
+		bool jitDifferential;
+		unsigned long jitMismatches;
+
+		// Where every instruction is counted, nullptr when not profiling
+		Profile *profile;
+
+		// Sources holding each interrupt line low, one bit per source. Devices may change them from
+		// other threads, the run loop samples them between instructions.
+		std::atomic<uint32_t> irqSources, nmiSources;
+
+		// Set on the falling edge of NMI, cleared when the NMI is taken
+		std::atomic<bool> nmiPending;
+
+		// Number of source bits handed out
+		int interruptSourcesUsed;
+
+		// Cycles executed since the Cpu was created. Updated after every instruction, by the JIT core
+		// after every compiled block.
+		uint64_t cycleCount;
+
+		// Instructions executed since the Cpu was created, interrupt entries not included. Only
+		// updated when a run call returns.
+		uint64_t instructionCount;
+
+		// Device events, due at values of cycleCount
+		Scheduler scheduler;
+
+		// Cheap test for the run loop, true if an interrupt may have to be taken or an event was
+		// scheduled before the end of the current slice
+		bool needsAttention()
+		{
+			return irqSources.load(std::memory_order_relaxed) || nmiPending.load(std::memory_order_relaxed) || scheduler.preempt;
+		}
+
+		// Enter the handler of a pending interrupt, if one can be taken. Returns the cycles used.
+		template <bool DECODED>
+		int takeInterrupt(ContextT<DECODED> &context);
+
+		long runScheduled(long budget, const std::function<bool(const RegisterSet &)> *stop);
+
+		// Instantiated with and without profiling, so the loops only count when a profile is set. GCC
+		// only flattens the instantiations when the attribute is on this declaration.
+		template <bool PROFILE>
+		__attribute__((flatten)) long runLoop(long budget, const std::function<bool(const RegisterSet &)> *stop, bool &stopped);
+		template <bool PROFILE>
+		long runBlocks(long budget, const std::function<bool(const RegisterSet &)> *stop, bool &stopped);
+		long runCompiled(Block *block, RegisterSet &registers);
+		void checkCompiled(const Block *block, const RegisterSet &before);
+
+	public:
+		Cpu(arx65::bus::Bus *bus);
+		~Cpu();
+
+		RegisterSet *getRegisters();
+		RegisterSet getRegistersCopy();
+
+		// Main initialization
+		void init();
+
+		// Call the CPU to do the next intruction, and return the number of cycles that instruction takes.
+		int doNextInstruction();
+
+		// Run instructions until at least budget cycles have elapsed, and return the cycles actually used.
+		// Registers are held locally for the whole batch and only written back when it returns.
+		long runCycles(long budget);
+
+		// Run until stop returns true after an instruction, or the budget runs out. Returns cycles used.
+		long runUntil(std::function<bool(const RegisterSet &)> stop, long budget = LONG_MAX);
+
+		// Cycles executed so far, the clock devices schedule their events against
+		uint64_t getCycles();
+		uint64_t getInstructions();
+
+		// Events due are run between instructions by doNextInstruction, runCycles and runUntil
+		Scheduler *getScheduler();
+
+		// Select the core used by doNextInstruction. The table core is kept for comparison.
+		// The block and JIT cores take interrupts and run due events only between blocks. Compiled
+		// blocks are never chained, even a loop on itself returns to the run loop every time round,
+		// so an IRQ or NMI waits at most one block: 64 instructions of up to 7 cycles, 448 cycles.
+		void setCore(Core core);
+		Core getCore();
+
+		// Run every compiled block of the JIT core a second time through the interpreter and report
+		// any difference in registers, cycles or writes on std::cerr. Much slower, for testing.
+		void setJitDifferential(bool enable);
+		unsigned long getJitMismatches();
+
+		// Count every instruction from here on into profile, or stop counting with nullptr. The profile
+		// is not owned. While profiling, the JIT core runs blocks through the block core instead of
+		// their compiled code, so that each instruction is seen. Built with ARX65_NO_PROFILE defined,
+		// profiles are ignored.
+		void setProfile(Profile *profile);
+		Profile *getProfile();
+
+		// Throw away all decoded code. Call after changing memory other than through the CPU,
+		// such as loading a new program into a SimpleMemory while the block core is selected.
+		void invalidateCode();
+
+		// Hand out a bit to identify one device on the interrupt lines. There are 32, after that 0 is
+		// returned, which never asserts anything.
+		uint32_t allocateInterruptSource();
 
-	// Main initialization
-	void init();
+		// IRQ is level triggered: it is taken before the next instruction that finds it asserted by any
+		// source while the interrupt flag is clear, so it is not lost while interrupts are disabled.
+		// A device must deassert it once it has been serviced.
+		void assertIRQ(uint32_t source);
+		void deassertIRQ(uint32_t source);
 
-	// Call the CPU to do the next intruction, and return the number of cycles that instruction takes.
-	int doNextInstruction();
-	int doNextInstructionDebug();
+		// NMI is edge triggered: it is taken once when the first source asserts it, regardless of the
+		// interrupt flag, and again only after every source has let go of it.
+		void assertNMI(uint32_t source);
+		void deassertNMI(uint32_t source);
 
-	// Non-Maskable Interrupt call, finds address from FFFA and FFFB (low/high) and executes regardless
-	void doNMI();
+		// Non-Maskable Interrupt call, finds address from FFFA and FFFB (low/high) and executes regardless.
+		// Enters the handler right away, devices should assert the NMI line instead.
+		void doNMI();
 
-	// Reset processor, of course, find address from FFFC, FFFD and go there.
-	void doRES();
+		// Reset processor, of course, find address from FFFC, FFFD and go there.
+		void doRES();
 
-	// Interrupt Request, FFFE and FFFF, interrupt flag must not be set already, but will be set until completed
-	void doIRQ();
-	
+		// Interrupt Request, FFFE and FFFF, interrupt flag must not be set already, but will be set until completed.
+		// Enters the handler right away, devices should assert the IRQ line instead.
+		void doIRQ();
+	};
 };
@@ -0,0 +1,61 @@
+#include "Common.h"
+
+#pragma once
+
+namespace arx65::cpu
+{
+	typedef uint64_t EventId;
+
+	/* Callbacks of devices at absolute cycle times of one Cpu, kept in a min-heap. The run loop
+	   executes straight up to the earliest deadline without polling anything, then calls whatever
+	   is due. Only use it from the thread running the Cpu, such as from a bus access or from
+	   another event. */
+	class Scheduler
+	{
+	public:
+		// Called with the cycle count at the time the event ran, which can be a few cycles past
+		// its deadline since instructions are not split
+		typedef std::function<void(uint64_t now)> Callback;
+
+	private:
+		typedef struct {
+			uint64_t cycle;
+			EventId id;
+			Callback callback;
+		} Event;
+
+		// Min-heap on cycle, then on id so events due at the same cycle run in the order scheduled
+		std::vector<Event> heap;
+
+		// Events cancelled while still in the heap, dropped when they reach the top
+		std::vector<EventId> cancelled;
+
+		EventId nextId;
+
+		static bool later(const Event &a, const Event &b);
+		bool isCancelled(EventId id);
+		void dropCancelled();
+
+	public:
+		// Set when an event is scheduled ahead of the earliest one so far, which the running slice
+		// of the Cpu was not told about. The run loop ends the slice early and clears it.
+		bool preempt;
+
+		Scheduler();
+
+		// Call back at an absolute cycle. The returned id stays valid until the event ran.
+		EventId schedule(uint64_t cycle, Callback callback);
+
+		// Forget an event that has not run yet. Returns false if it already ran or was cancelled.
+		bool cancel(EventId id);
+
+		// Cycle of the earliest event, or UINT64_MAX if none is scheduled
+		uint64_t nextDeadline();
+
+		// Run every event due at or before now in deadline order, including those the callbacks
+		// schedule for now or earlier.
+		void runDue(uint64_t now);
+
+		size_t pending();
+	};
+}
@@ -0,0 +1,58 @@
+#include "Common.h"
+
+#pragma once
+
+namespace arx65
+{
+	/* Fixed size lock-free queue between exactly one producer thread and one consumer thread, such
+	   as input going into an emulation thread and output coming back. Neither side ever waits: push
+	   fails when full and pop when empty, so each side decides what to do about it. */
+	template <typename T, size_t CAPACITY>
+	class SpscQueue
+	{
+		static_assert(CAPACITY && !(CAPACITY & (CAPACITY - 1)), "SpscQueue capacity must be a power of two");
+
+	private:
+		T items[CAPACITY];
+
+		// Free running counters, only ever advanced by their own side. On separate cache lines so the
+		// two threads do not keep taking the line from each other.
+		alignas(64) std::atomic<size_t> head;		// Next to pop, written by the consumer
+		alignas(64) std::atomic<size_t> tail;		// Next to push, written by the producer
+
+	public:
+		SpscQueue() : head(0), tail(0) {}
+
+		// Producer side. Returns false if the queue is full.
+		bool push(const T &item)
+		{
+			size_t t = tail.load(std::memory_order_relaxed);
+			if (t - head.load(std::memory_order_acquire) == CAPACITY) return false;
+			items[t & (CAPACITY - 1)] = item;
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Producer side. Room for at least this many more items.
+		size_t space()
+		{
+			return CAPACITY - (tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire));
+		}
+
+		// Consumer side. Returns false if the queue is empty.
+		bool pop(T &item)
+		{
+			size_t h = head.load(std::memory_order_relaxed);
+			if (h == tail.load(std::memory_order_acquire)) return false;
+			item = std::move(items[h & (CAPACITY - 1)]);
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Either side, only a hint while the other side is running
+		bool empty()
+		{
+			return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+		}
+	};
+}
@@ -0,0 +1,47 @@
+#include "Common.h"
+#include "Processor.h"
+
+#pragma once
+
+namespace arx65::cli
+{
+    // Exit codes shared by the subcommands
+    const int EXIT_STOPPED = 0;     // Reached a requested stop, or passed
+    const int EXIT_TRAPPED = 1;     // Stuck in a loop on itself anywhere else, or failed
+    const int EXIT_LIMIT = 2;       // Ran out of cycles
+    const int EXIT_SETUP = 3;       // Bad arguments or a file that could not be loaded
+
+    // Entry point when args[1] is a subcommand. Returns the exit code of the process.
+    int mainCli(int argc, char *args[]);
+
+    // True if name is a subcommand rather than an option for the GUI
+    bool isCommand(const char *name);
+
+    // Subcommands, each gets the arguments after its own name
+    int runCommand(int argc, char *args[]);
+    int benchCommand(int argc, char *args[]);
+    int microCommand(int argc, char *args[]);
+    int klausCommand(int argc, char *args[]);
+    int vectorsCommand(int argc, char *args[]);
+
+    // Shared argument parsing. Numbers are decimal, or hex with a $ or 0x prefix. When the text is
+    // not valid these say why on std::cerr and return false.
+    bool parseNumber(const std::string &text, uint64_t &value);
+    bool parseAddress(const std::string &text, uint16_t &address);
+    bool parseCore(const std::string &text, arx65::cpu::Core &core);
+
+    // A JMP or taken branch to its own address, how test programs stop
+    bool isTrap(arx65::bus::Bus &bus, uint16_t pc);
+
+    // How an addressing mode is written in listings, such as "(zp),Y". Empty for implied.
+    const char *modeSyntax(arx65::cpu::Mode mode);
+
+    // One instruction in assembler syntax. Only plain memory is read, anything on a device shows as ???.
+    std::string disassemble(arx65::bus::Bus &bus, uint16_t pc);
+
+    // Reports of a profile, the addresses and opcodes that took the most cycles first, each address
+    // disassembled from memory as it is now. The text report lists the top addresses and every opcode,
+    // the CSV has a row for every address and opcode that ran.
+    void writeProfileText(const arx65::cpu::Profile &profile, arx65::bus::Bus &bus, std::ostream &out, size_t top);
+    void writeProfileCsv(const arx65::cpu::Profile &profile, arx65::bus::Bus &bus, std::ostream &out);
+}
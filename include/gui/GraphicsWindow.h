@@ -1,5 +1,8 @@
 #include "Common.h"
 
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
 #pragma once
 
 namespace arx65::GUI
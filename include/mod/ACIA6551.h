@@ -1,12 +1,49 @@
 #include "Common.h"
 #include "BusConnection.h"
+#include "Scheduler.h"
 
 #pragma once
 
 using namespace std;
 
+namespace arx65::cpu
+{
+    class Cpu;
+}
+
 namespace arx65::mod
 {
+    /* Fixed capacity byte queue for the ACIA, with bulk copies in at most two chunks */
+    class ByteFifo
+    {
+    private:
+        static const int CAPACITY = 4096;
+        uint8_t data[CAPACITY];
+        int head, count;
+
+    public:
+        ByteFifo();
+
+        int size();
+        int space();
+        bool empty();
+        bool full();
+        void clear();
+
+        // Single bytes, push fails when full and pop must not be called when empty
+        bool push(uint8_t byte);
+        uint8_t pop();
+
+        // As many as fit or are there, up to len. Return how many were copied.
+        int push(const uint8_t *bytes, int len);
+        int pop(uint8_t *bytes, int len);
+    };
+
+    /* MOS 6551 serial interface. The host side is a pair of FIFOs standing in for the far end of the
+       line. Bytes cross the line one frame at a time at the baud rate and word format selected in
+       the control register, counted in cycles of the Cpu through its scheduler, unless the chip is
+       unthrottled, has no Cpu, or is set to the external clock (baud select 0). Then they cross
+       at once, and the receive data register is simply the front of the receive FIFO. */
     class ACIA6551 : public BusConnection
     {
     private:
@@ -16,21 +53,80 @@ namespace arx65::mod
         uint8_t control_register;
         uint8_t status_register;
 
-        vector<uint8_t> transmit, receive;
+        // Bytes from the host waiting to go down the line, and bytes from the program that came out
+        ByteFifo transmit, receive;
+
+        // Receive and transmit data registers, and the byte in the transmit shift register
+        uint8_t receiveData, transmitData, shifting;
+        bool receiveFull, transmitFull, shifterBusy;
+
+        // A byte is on its way down the line into the receive data register
+        bool receiving;
+
+        // Scheduler events of the frames on the line in each direction, valid while receiving or
+        // shifterBusy is set, so a reset can take them back
+        arx65::cpu::EventId receiveEvent, transmitEvent;
+
+        // Move bytes instantly regardless of the control register
+        bool unthrottled;
+
+        // Modem inputs, DCD and DSR. Both read as low in the status register while set.
+        bool carrier, dataSetReady;
+
+        // Clock of the Cpu, to turn the baud rate into cycles
+        double cpuHz;
+
+        // Processor whose IRQ line this chip drives and whose cycles time the line, and the source
+        // bit it asserts IRQ with
+        arx65::cpu::Cpu *cpu;
+        uint32_t irqSource;
+
+        // Cycles one frame takes on the line, start, data, parity and stop bits. 0 when instant.
+        long frameCycles();
+
+        // Start moving whatever can move next in either direction
+        void pumpReceive();
+        void pumpTransmit();
+
+        // The byte in the shift register has crossed the line
+        void shiftOut(uint64_t now);
+
+        // A byte arrives in the receive data register, or is lost to an overrun if it is still full
+        void receiveByte(uint8_t byte);
+
+        // Flag a received byte in the status register and interrupt, if enabled
+        void receiveInterrupt();
     
     public:
-        ACIA6551(uint16_t address);
+        ACIA6551(uint16_t address, arx65::cpu::Cpu *irqTarget = nullptr, double cpuClockHz = 1000000);
 
         // Required functions
         bool isAddressInRange(uint16_t addr, bool read);
 		uint8_t read(uint16_t address);
 		void write(uint16_t address, uint8_t byte);
 
+        // Move bytes as fast as both ends take them, for batch runs
+        void setUnthrottled(bool enable);
+        void setCpuClock(double hz);
+
+        // Modem lines from the far end, so a program can tell whether anyone is connected.
+        // Both are on unless a host bridge says otherwise.
+        void setCarrier(bool detected);
+        void setDataSetReady(bool ready);
+
+        // Host side of the transmitter
         int bytesAvailable();
         uint8_t nextByte();
         void clearBytes();
 
-        void sendByte(const uint8_t byte);
-        void sendBytes(const uint8_t *byte, int len = -1);
+        // Take up to len transmitted bytes at once, returns how many were copied
+        int drainBytes(uint8_t *buffer, int len);
+
+        // Host side of the receiver. A byte sent while the receive FIFO is full is dropped and sets
+        // the overrun bit. sendBytes instead takes only what fits and returns how many that was, so
+        // the rest can be sent once the program has caught up. A len of -1 sends up to the first 0.
+        // Nothing is taken while DTR is off.
+        bool sendByte(const uint8_t byte);
+        int sendBytes(const uint8_t *byte, int len = -1);
     };
-}
\ No newline at end of file
+}
@@ -21,6 +21,7 @@ namespace arx65::mod
 		bool isAddressInRange(uint16_t addr, bool read);
 		uint8_t read(uint16_t address);
 		void write(uint16_t address, uint8_t byte);
+		bool getMemorySpan(MemorySpan &span);
 	};
 }
 #endif
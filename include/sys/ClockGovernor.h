@@ -0,0 +1,72 @@
+#include "Common.h"
+
+#pragma once
+
+namespace arx65::sys
+{
+    /* Paces a machine to a target clock rate against the host clock. The caller asks how many
+       cycles are due by its next deadline, runs them in batches, and sleeps until that deadline
+       instead of spinning. */
+    class ClockGovernor
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        // Falling further behind than this is given up rather than caught up in one burst
+        static constexpr std::chrono::milliseconds MAX_LAG{100};
+
+    private:
+        // Target in cycles per second, 0 for unlimited
+        double hz;
+
+        // Running unpaced for now, pacing starts over from the moment it ends
+        bool turbo;
+
+        // Host time of emulated cycle 0. Moves forward when time is given up.
+        Clock::time_point origin;
+
+        // Cycles run since origin
+        uint64_t cycles;
+
+        // Host time given up in total because the machine could not keep up
+        Clock::duration slipped;
+
+        // Window for report()
+        Clock::time_point reportStart;
+        uint64_t reportCycles;
+        Clock::duration reportSlipped;
+
+        Clock::duration emulatedTime();
+        void restart();
+
+    public:
+        // Target clock in MHz, 0 for unlimited
+        ClockGovernor(double mhz);
+
+        // Change the target clock. Starts pacing over from now.
+        void setSpeed(double mhz);
+        double getSpeed();
+        bool isUnlimited();
+
+        // Fast-forward. The caller runs as much as it can and still accounts for it, report() then
+        // gives the speed as a multiple of the target.
+        void setTurbo(bool on);
+        bool isTurbo();
+
+        // Cycles still to run so the machine reaches deadline in emulated time, 0 if it is already
+        // there. Always 0 when unlimited or in turbo, the caller decides how much to run.
+        long cyclesUntil(Clock::time_point deadline);
+
+        // Count cycles the machine actually ran
+        void account(long used);
+
+        // Sleep until deadline, returns right away if it has passed
+        void sleepUntil(Clock::time_point deadline);
+
+        // Emulated time minus host time since the start. Negative when the machine is behind.
+        Clock::duration getDrift();
+
+        // Effective speed, drift and time given up since the previous call, on one line
+        std::string report();
+    };
+}
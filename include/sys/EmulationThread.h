@@ -0,0 +1,38 @@
+#include "Common.h"
+#include "SpscQueue.h"
+#include "sys/ISystem.h"
+#include "sys/ClockGovernor.h"
+
+#pragma once
+
+namespace arx65::sys
+{
+    /* Runs a system's tick on its own thread, paced by a ClockGovernor, so rendering and emulation
+       no longer stall each other. Only tick and isTurbo of the system are called from this thread. */
+    class EmulationThread
+    {
+    private:
+        ISystem *system;
+        ClockGovernor governor;
+
+        std::thread thread;
+        std::atomic<bool> running;
+
+        // One line from the governor about every second, for the UI to show
+        SpscQueue<std::string, 4> reports;
+
+        void run();
+
+    public:
+        EmulationThread(ISystem *system, double mhz);
+        ~EmulationThread();
+
+        void start();
+
+        // Returns once the current batch has finished and the thread has ended
+        void stop();
+
+        // Latest speed report, false if there is none since the last call
+        bool nextReport(std::string &report);
+    };
+}
@@ -1,10 +1,13 @@
 #include "Common.h"
 
+#include <SDL2/SDL.h>
+
 #pragma once
 
 namespace arx65::sys
 {
-    /* Holds a specific system configuration */
+    /* Holds a specific system configuration. tick and isTurbo are called on the emulation thread, the
+       rest on the UI thread, so anything passing between the two goes through an SpscQueue or an atomic. */
     class ISystem
     {
     public:
@@ -12,11 +15,14 @@ namespace arx65::sys
         virtual void init();
         virtual void deinit();
 
-        /* Called very frequently. Maybe can be used for processor control. */
-        virtual void tick(double delta);
+        /* Called very frequently. Run up to cycleBudget cycles of the machine, return cycles used. */
+        virtual long tick(long cycleBudget);
 
-        /* Called when the main loop is ready for a graphics redraw (~60FPS). */
+        /* Called when the main loop is ready for a graphics redraw (~60FPS). Fewer frames are drawn in turbo. */
         virtual void drawGraphics(SDL_Renderer *renderer, double delta);
+
+        /* True while the system should run as fast as the host allows instead of at its clock rate. */
+        virtual bool isTurbo();
         
         /* Event handlers. These are called before tick and drawGraphics in the main loop. */
         virtual void keyPressEvent(SDL_Keysym k);
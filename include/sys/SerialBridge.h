@@ -0,0 +1,86 @@
+#include "Common.h"
+#include "SpscQueue.h"
+#include "mod/ACIA6551.h"
+
+#pragma once
+
+namespace arx65::sys
+{
+    /* Where a SerialBridge connects an ACIA */
+    enum BridgeMode {
+        BRIDGE_PTY,         // A new pseudo-terminal, open its slave with any terminal program
+        BRIDGE_SOCKET,      // A Unix domain socket at a path, one client at a time
+        BRIDGE_STDIO        // stdin and stdout of the emulator. A terminal is left in its own mode, so
+                            // typed input normally arrives a line at a time, with echo.
+    };
+
+    /* Connects an ACIA6551 to a host file descriptor. An epoll thread moves bytes between the host
+       and two lock-free queues, and service() moves them between the queues and the chip on the
+       thread running the machine. Nothing is dropped: when the program reads slower than the host
+       writes, the bridge stops reading and the host blocks, and when the host reads slower than the
+       program writes, TDRE stays clear. Whether a client is connected shows as DCD. Linux only. */
+    class SerialBridge
+    {
+    private:
+        arx65::mod::ACIA6551 *acia;
+        BridgeMode mode;
+        std::string name;
+
+        // Host side. inFd and outFd are the same for a pty or socket client, -1 while unconnected.
+        // For stdio they are the bridge's own, so stdin, stdout and stderr stay blocking.
+        int inFd, outFd, listenFd, slaveFd;
+        int epollFd, wakeFd;
+
+        // Host file descriptors are not epoll-able when they are regular files, those are tried
+        // every few milliseconds instead
+        bool inPolled, outPolled;
+
+        // End of input seen, for stdio
+        bool inputDone;
+
+        std::thread thread;
+        std::atomic<bool> running, connected;
+
+        // After running is cleared, output is still written until this time
+        std::chrono::steady_clock::time_point drainUntil;
+
+        // Host to chip and chip to host
+        arx65::SpscQueue<uint8_t, 65536> toDevice, fromDevice;
+
+        // Bytes popped from fromDevice the host did not take yet, only used by the I/O thread
+        std::vector<uint8_t> pendingOutput;
+        size_t pendingOffset;
+
+        // Bytes taken from toDevice that the chip had no room for yet, only used by service()
+        uint8_t pendingInput[4096];
+        int inputCount, inputOffset;
+
+        void run();
+        void wake();
+        void watch(int fd, bool &polled);
+        void updateInterest();
+        void acceptClient();
+        // Let go of the host end after reading from it (input) or writing to it failed. A socket
+        // client or the pty goes as a whole, with stdio only the side that failed.
+        void dropClient(bool input);
+        bool readHost();
+        bool writeHost();
+
+    public:
+        SerialBridge(arx65::mod::ACIA6551 *acia);
+        ~SerialBridge();
+
+        // Set up the host side and start the I/O thread. path is the socket path, unused otherwise.
+        // Returns false and says why on std::cerr if it could not.
+        bool open(BridgeMode mode, const std::string &path = "");
+        // Stops the I/O thread once it wrote what the chip sent, or gave up after a second
+        void close();
+
+        // Path of the pty slave or socket, for the user to connect to
+        std::string getName();
+
+        // Move bytes between the queues and the chip. Call from the thread running the machine,
+        // between batches.
+        void service();
+    };
+}
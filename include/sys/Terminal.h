@@ -2,6 +2,9 @@
 #include "sys/ISystem.h"
 #include "mod/ACIA6551.h"
 #include "mod/SimpleMemory.h"
+#include "Databus.h"
+#include "Processor.h"
+#include "SpscQueue.h"
 
 #pragma once
 
@@ -20,22 +23,38 @@ namespace arx65::sys
         arx65::mod::SimpleMemory *progRAM, *quickROM;
         arx65::mod::ACIA6551 *acia;
 
-        bool freerun;
+        arx65::bus::Bus *bus;
+        arx65::cpu::Cpu *cpu;
+
+        /* Typed bytes for the ACIA, from the UI thread to tick */
+        arx65::SpscQueue<uint8_t, 256> input;
+
+        /* ACIA output for the screen, from tick to drawGraphics. When it is full the rest waits in the ACIA. */
+        arx65::SpscQueue<uint8_t, 4096> output;
+
+        /* Turbo while Right-Ctrl is held, or toggled with F12 */
+        std::atomic<bool> freerun, freerunLatched;
+
+        /* Core to go back to after turbo, which uses the JIT */
+        arx65::cpu::Core normalCore;
 
         void addToScreenBuffer(char c);
         void backspaceScreenBuffer();
     public:
-        Terminal(int screenWidth, int screenHeight);
+        /* The clock in MHz times the serial line, 0 for unlimited counts as 1 MHz there */
+        Terminal(int screenWidth, int screenHeight, double clockMHz);
         ~Terminal();
 
         /* Called when ready to begin. If using a 6502 CPU, this should launch it on another thread? Maybe not. */
         void init();
 
-        /* Called very frequently. Maybe can be used for processor control. */
-        void tick(double delta);
+        /* Called very frequently. Run up to cycleBudget cycles of the machine, return cycles used. */
+        long tick(long cycleBudget);
 
         /* Called when the main loop is ready for a graphics redraw (~60FPS). */
         void drawGraphics(SDL_Renderer *renderer, double delta);
+
+        bool isTurbo();
         
         /* Event handlers. These are called before tick and drawGraphics in the main loop. */
         void keyPressEvent(SDL_Keysym k);
@@ -0,0 +1,78 @@
+#include "BlockCache.h"
+
+namespace arx65::cpu
+{
+	BlockCache::BlockCache()
+	{
+		for (int p = 0; p < 256; p++)
+		{
+			entries[p] = nullptr;
+			codePage[p] = 0;
+		}
+
+		generation = 0;
+	}
+
+	BlockCache::~BlockCache()
+	{
+		clear();
+		collect();
+
+		for (int p = 0; p < 256; p++) delete[] entries[p];
+	}
+
+	void BlockCache::insert(Block *block)
+	{
+		Block **&page = entries[block->start >> 8];
+		if (page == nullptr) page = new Block *[256]();
+
+		page[block->start & 0xFF] = block;
+
+		for (int p = block->start >> 8; p <= block->end >> 8; p++)
+		{
+			overlapping[p].push_back(block);
+			codePage[p] = 1;
+		}
+	}
+
+	void BlockCache::invalidatePage(uint8_t page)
+	{
+		std::vector<Block *> dropped;
+		dropped.swap(overlapping[page]);
+		codePage[page] = 0;
+
+		for (Block *block : dropped)
+		{
+			// Unlink from the other pages this block covers
+			for (int p = block->start >> 8; p <= block->end >> 8; p++)
+			{
+				if (p == page) continue;
+
+				std::vector<Block *> &list = overlapping[p];
+				list.erase(std::remove(list.begin(), list.end(), block), list.end());
+				if (list.empty()) codePage[p] = 0;
+			}
+
+			Block **entry = &entries[block->start >> 8][block->start & 0xFF];
+			if (*entry == block) *entry = nullptr;
+
+			retired.push_back(block);
+		}
+
+		++generation;
+	}
+
+	void BlockCache::clear()
+	{
+		for (int p = 0; p < 256; p++)
+		{
+			if (!overlapping[p].empty()) invalidatePage(p);
+		}
+	}
+
+	void BlockCache::collect()
+	{
+		for (Block *block : retired) delete block;
+		retired.clear();
+	}
+}
@@ -3,40 +3,113 @@
 
 namespace arx65::bus
 {
-	std::vector<arx65::mod::BusConnection *> connections;
+	Bus::Bus()
+	{
+		mapVersion = 0;
+		rebuildPageMap();
+	}
 
-	uint8_t read(uint16_t address) 
+	uint8_t Bus::readDevice(uint16_t address)
 	{
-		for (arx65::mod::BusConnection *b : connections)
+		const Page &page = pages[address >> 8];
+
+		if (page.reader) return page.reader->read(address);
+
+		if (page.sharedRead)
 		{
-			if (b->isAddressInRange(address, true))
-			{
-				return b->read(address);
-			}
+			arx65::mod::BusConnection *b = findDevice(address, true);
+			if (b) return b->read(address);
 		}
 
 		return 0;
 	}
 
-	void write(uint16_t address, uint8_t byte)
+	void Bus::writeDevice(uint16_t address, uint8_t byte)
 	{
-		for (arx65::mod::BusConnection *b : connections)
+		const Page &page = pages[address >> 8];
+
+		if (page.writer)
 		{
-			if (b->isAddressInRange(address, false))
-			{
-				b->write(address, byte);
-				break;
-			}
+			page.writer->write(address, byte);
+		}
+		else if (page.sharedWrite)
+		{
+			arx65::mod::BusConnection *b = findDevice(address, false);
+			if (b) b->write(address, byte);
 		}
 	}
 
-	void attach(arx65::mod::BusConnection *device)
+	uint8_t *Bus::getDirectRange(uint16_t start, uint16_t end)
+	{
+		uint8_t *base = directRead[start >> 8];
+		if (base == nullptr) return nullptr;
+
+		for (int p = start >> 8; p <= end >> 8; p++)
+		{
+			uint8_t *expected = base + ((p - (start >> 8)) << 8);
+			if (directRead[p] != expected || directWrite[p] != expected) return nullptr;
+		}
+
+		return base + (start & 0xFF);
+	}
+
+	void Bus::attach(arx65::mod::BusConnection *device)
 	{
 		connections.push_back(device);
+		rebuildPageMap();
 	}
 
-	void clear()
+	void Bus::clear()
 	{
 		connections.clear();
+		rebuildPageMap();
+	}
+
+	arx65::mod::BusConnection *Bus::findDevice(uint16_t address, bool read)
+	{
+		// The first device attached wins, so devices attached earlier can sit on top of memory
+		for (arx65::mod::BusConnection *b : connections)
+		{
+			if (b->isAddressInRange(address, read)) return b;
+		}
+
+		return nullptr;
+	}
+
+	void Bus::rebuildPageMap()
+	{
+		++mapVersion;
+
+		for (int p = 0; p < 256; p++)
+		{
+			arx65::mod::BusConnection *reader = findDevice(p << 8, true);
+			arx65::mod::BusConnection *writer = findDevice(p << 8, false);
+			bool sharedRead = false, sharedWrite = false;
+
+			for (int offset = 1; offset < 256; offset++)
+			{
+				sharedRead |= findDevice((p << 8) | offset, true) != reader;
+				sharedWrite |= findDevice((p << 8) | offset, false) != writer;
+			}
+
+			pages[p].reader = sharedRead ? nullptr : reader;
+			pages[p].writer = sharedWrite ? nullptr : writer;
+			pages[p].sharedRead = sharedRead;
+			pages[p].sharedWrite = sharedWrite;
+
+			directRead[p] = nullptr;
+			directWrite[p] = nullptr;
+
+			// Plain memory covering the whole page gets loaded from and stored to directly
+			arx65::mod::MemorySpan span;
+			if (pages[p].reader && pages[p].reader->getMemorySpan(span) && span.start <= (p << 8) && span.end >= ((p << 8) | 0xFF))
+			{
+				directRead[p] = span.data + ((p << 8) - span.start);
+			}
+			if (pages[p].writer && pages[p].writer->getMemorySpan(span) && span.writable && span.start <= (p << 8) && span.end >= ((p << 8) | 0xFF))
+			{
+				directWrite[p] = span.data + ((p << 8) - span.start);
+			}
+		}
 	}
 }
\ No newline at end of file
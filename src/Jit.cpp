@@ -0,0 +1,1049 @@
+#include "Jit.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define ARX65_JIT_X86_64
+#include <sys/mman.h>
+#include <cstddef>
+#endif
+
+namespace arx65::cpu
+{
+	JitLogger::JitLogger(arx65::bus::Bus *target)
+	{
+		this->target = target;
+	}
+
+	bool JitLogger::isAddressInRange(uint16_t, bool)
+	{
+		return true;
+	}
+
+	uint8_t JitLogger::read(uint16_t address)
+	{
+		uint8_t byte = target->read(address);
+		if (!target->isDirectRead(address)) log.push_back({address, byte, 0, false, false});
+		return byte;
+	}
+
+	void JitLogger::write(uint16_t address, uint8_t byte)
+	{
+		uint8_t *page = target->getDirectWritePages()[address >> 8];
+		log.push_back({address, byte, page ? page[address & 0xFF] : (uint8_t)0, true, page != nullptr});
+		target->write(address, byte);
+	}
+
+	JitReplay::JitReplay(arx65::bus::Bus *target, const std::vector<JitAccess> &log) : log(log)
+	{
+		this->target = target;
+		nextRead = 0;
+		diverged = false;
+	}
+
+	void JitReplay::reset()
+	{
+		nextRead = 0;
+		diverged = false;
+		written.clear();
+		writes.clear();
+	}
+
+	bool JitReplay::isAddressInRange(uint16_t, bool)
+	{
+		return true;
+	}
+
+	uint8_t JitReplay::read(uint16_t address)
+	{
+		if (target->isDirectRead(address))
+		{
+			auto it = written.find(address);
+			return it != written.end() ? it->second : target->read(address);
+		}
+
+		// Devices are not read twice, the compiled code's reads are handed out in order instead
+		while (nextRead < log.size() && (log[nextRead].write || log[nextRead].direct)) ++nextRead;
+		if (nextRead < log.size() && log[nextRead].address == address) return log[nextRead++].value;
+
+		diverged = true;
+		return 0;
+	}
+
+	void JitReplay::write(uint16_t address, uint8_t byte)
+	{
+		writes.push_back({address, byte, 0, true, target->getDirectWritePages()[address >> 8] != nullptr});
+		if (target->isDirectRead(address)) written[address] = byte;
+	}
+
+#ifdef ARX65_JIT_X86_64
+	namespace
+	{
+		// Host registers. The 6502 registers live in callee saved ones, so helper calls keep them.
+		enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+		const int REG_A = R12, REG_X = R13, REG_Y = R14, REG_P = R15;
+
+		// Last result byte, while N and Z are held lazily instead of in REG_P
+		const int REG_NZ = RBP;
+
+		// The JitState
+		const int REG_STATE = RBX;
+
+		// Condition codes
+		enum { CC_B = 2, CC_AE = 3, CC_E = 4, CC_NE = 5, CC_S = 8, CC_NS = 9 };
+
+		const int32_t OFF_A = offsetof(JitState, R) + offsetof(RegisterSet, A);
+		const int32_t OFF_X = offsetof(JitState, R) + offsetof(RegisterSet, X);
+		const int32_t OFF_Y = offsetof(JitState, R) + offsetof(RegisterSet, Y);
+		const int32_t OFF_P = offsetof(JitState, R) + offsetof(RegisterSet, Flags);
+		const int32_t OFF_SP = offsetof(JitState, R) + offsetof(RegisterSet, SP);
+		const int32_t OFF_PC = offsetof(JitState, R) + offsetof(RegisterSet, PC);
+		const int32_t OFF_CYCLES = offsetof(JitState, cycles);
+		const int32_t OFF_COMPLETED = offsetof(JitState, completed);
+		const int32_t OFF_SCRATCH = offsetof(JitState, scratch);
+		const int32_t OFF_ADDRESS = offsetof(JitState, address);
+		const int32_t OFF_NZ = offsetof(JitState, nz);
+
+		/* Byte level x86-64 encoding, only what the compiler below needs. Opcodes above 0xFF are
+		   two byte opcodes starting with 0x0F. Writing past the limit only marks the buffer full. */
+		class Assembler
+		{
+		public:
+			uint8_t *start, *at, *limit;
+
+			Assembler(uint8_t *start, uint8_t *limit) : start(start), at(start), limit(limit) {}
+
+			bool full()
+			{
+				return at > limit;
+			}
+
+			size_t position()
+			{
+				return at - start;
+			}
+
+			void byte(uint8_t b)
+			{
+				if (at < limit) *at = b;
+				++at;
+			}
+
+			void u32(uint32_t v)
+			{
+				for (int i = 0; i < 4; i++) byte(v >> (i * 8));
+			}
+
+			void u64(uint64_t v)
+			{
+				for (int i = 0; i < 8; i++) byte(v >> (i * 8));
+			}
+
+			void opcode(uint16_t op)
+			{
+				if (op > 0xFF) byte(op >> 8);
+				byte(op & 0xFF);
+			}
+
+			// spl, bpl, sil and dil can only be used as bytes with a REX prefix
+			static bool needsRex(int reg)
+			{
+				return reg >= RSP && reg <= RDI;
+			}
+
+			void rex(bool wide, int reg, int index, int base, bool force)
+			{
+				uint8_t r = 0x40 | (wide ? 8 : 0) | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((base & 8) >> 3);
+				if (r != 0x40 || force) byte(r);
+			}
+
+			// op reg, rm with two registers. bytes marks byte sized registers.
+			void rr(uint16_t op, int reg, int rm, bool wide = false, bool bytes = false)
+			{
+				rex(wide, reg, 0, rm, bytes && (needsRex(reg) || needsRex(rm)));
+				opcode(op);
+				byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+			}
+
+			// op reg, [base + index << scale + disp]
+			void rm(uint16_t op, int reg, int base, int32_t disp, int index = -1, int scale = 0, bool wide = false, bool bytes = false)
+			{
+				rex(wide, reg, index < 0 ? 0 : index, base, bytes && needsRex(reg));
+				opcode(op);
+				if (index < 0 && (base & 7) != RSP)
+				{
+					byte(0x80 | ((reg & 7) << 3) | (base & 7));
+				}
+				else
+				{
+					byte(0x84 | ((reg & 7) << 3));
+					byte((scale << 6) | (((index < 0 ? RSP : index) & 7) << 3) | (base & 7));
+				}
+				u32(disp);
+			}
+
+			void mov32(int reg, uint32_t value)
+			{
+				rex(false, 0, 0, reg, false);
+				byte(0xB8 | (reg & 7));
+				u32(value);
+			}
+
+			void mov64(int reg, const void *value)
+			{
+				rex(true, 0, 0, reg, false);
+				byte(0xB8 | (reg & 7));
+				u64((uint64_t)value);
+			}
+
+			void push(int reg)
+			{
+				rex(false, 0, 0, reg, false);
+				byte(0x50 | (reg & 7));
+			}
+
+			void pop(int reg)
+			{
+				rex(false, 0, 0, reg, false);
+				byte(0x58 | (reg & 7));
+			}
+
+			void call(const void *function)
+			{
+				mov64(RAX, function);
+				rr(0xFF, 2, RAX);
+			}
+
+			// Forward jumps return where they end, to be patched by bind()
+			size_t jcc(int cc)
+			{
+				opcode(0x0F80 | cc);
+				u32(0);
+				return position();
+			}
+
+			size_t jmp()
+			{
+				byte(0xE9);
+				u32(0);
+				return position();
+			}
+
+			void jmpTo(size_t target)
+			{
+				byte(0xE9);
+				u32(target - (position() + 4));
+			}
+
+			void bind(size_t jump)
+			{
+				if (start + jump > limit) return;
+				int32_t rel = position() - jump;
+				memcpy(start + jump - 4, &rel, 4);
+			}
+		};
+
+		/* Kinds of instruction with a native version that follow the usual addressing modes */
+		enum Kind { K_NONE, K_LDA, K_LDX, K_LDY, K_AND, K_ORA, K_EOR, K_CMP, K_CPX, K_CPY, K_STA, K_STX, K_STY, K_INC, K_DEC, K_ASL, K_LSR, K_ROL, K_ROR };
+		enum Mode { M_IMPLIED, M_IMMEDIATE, M_ZP, M_ZPX, M_ZPY, M_ABSOLUTE, M_ABSOLUTEX, M_ABSOLUTEY, M_INDIRECTX, M_INDIRECTY };
+
+		typedef struct {
+			uint8_t opcode;
+			Kind kind;
+			Mode mode;
+			uint8_t cycles;
+		} NativeOp;
+
+		// Cycles before a page crossing, which loads in the indexed modes add while running
+		const NativeOp NATIVE_OPS[] = {
+			{0xA9, K_LDA, M_IMMEDIATE, 2}, {0xA5, K_LDA, M_ZP, 3}, {0xB5, K_LDA, M_ZPX, 4}, {0xAD, K_LDA, M_ABSOLUTE, 4},
+			{0xBD, K_LDA, M_ABSOLUTEX, 4}, {0xB9, K_LDA, M_ABSOLUTEY, 4}, {0xA1, K_LDA, M_INDIRECTX, 6}, {0xB1, K_LDA, M_INDIRECTY, 5},
+			{0xA2, K_LDX, M_IMMEDIATE, 2}, {0xA6, K_LDX, M_ZP, 3}, {0xB6, K_LDX, M_ZPY, 4}, {0xAE, K_LDX, M_ABSOLUTE, 4},
+			{0xBE, K_LDX, M_ABSOLUTEY, 4},
+			{0xA0, K_LDY, M_IMMEDIATE, 2}, {0xA4, K_LDY, M_ZP, 3}, {0xB4, K_LDY, M_ZPX, 4}, {0xAC, K_LDY, M_ABSOLUTE, 4},
+			{0xBC, K_LDY, M_ABSOLUTEX, 4},
+			{0x29, K_AND, M_IMMEDIATE, 2}, {0x25, K_AND, M_ZP, 3}, {0x35, K_AND, M_ZPX, 4}, {0x2D, K_AND, M_ABSOLUTE, 4},
+			{0x3D, K_AND, M_ABSOLUTEX, 4}, {0x39, K_AND, M_ABSOLUTEY, 4}, {0x21, K_AND, M_INDIRECTX, 6}, {0x31, K_AND, M_INDIRECTY, 5},
+			{0x09, K_ORA, M_IMMEDIATE, 2}, {0x05, K_ORA, M_ZP, 3}, {0x15, K_ORA, M_ZPX, 4}, {0x0D, K_ORA, M_ABSOLUTE, 4},
+			{0x1D, K_ORA, M_ABSOLUTEX, 4}, {0x19, K_ORA, M_ABSOLUTEY, 4}, {0x01, K_ORA, M_INDIRECTX, 6}, {0x11, K_ORA, M_INDIRECTY, 5},
+			{0x49, K_EOR, M_IMMEDIATE, 2}, {0x45, K_EOR, M_ZP, 3}, {0x55, K_EOR, M_ZPX, 4}, {0x4D, K_EOR, M_ABSOLUTE, 4},
+			{0x5D, K_EOR, M_ABSOLUTEX, 4}, {0x59, K_EOR, M_ABSOLUTEY, 4}, {0x41, K_EOR, M_INDIRECTX, 6}, {0x51, K_EOR, M_INDIRECTY, 5},
+			{0xC9, K_CMP, M_IMMEDIATE, 2}, {0xC5, K_CMP, M_ZP, 3}, {0xD5, K_CMP, M_ZPX, 4}, {0xCD, K_CMP, M_ABSOLUTE, 4},
+			{0xDD, K_CMP, M_ABSOLUTEX, 4}, {0xD9, K_CMP, M_ABSOLUTEY, 4}, {0xC1, K_CMP, M_INDIRECTX, 6}, {0xD1, K_CMP, M_INDIRECTY, 5},
+			{0xE0, K_CPX, M_IMMEDIATE, 2}, {0xE4, K_CPX, M_ZP, 3}, {0xEC, K_CPX, M_ABSOLUTE, 4},
+			{0xC0, K_CPY, M_IMMEDIATE, 2}, {0xC4, K_CPY, M_ZP, 3}, {0xCC, K_CPY, M_ABSOLUTE, 4},
+			{0x85, K_STA, M_ZP, 3}, {0x95, K_STA, M_ZPX, 4}, {0x8D, K_STA, M_ABSOLUTE, 4}, {0x9D, K_STA, M_ABSOLUTEX, 5},
+			{0x99, K_STA, M_ABSOLUTEY, 5}, {0x81, K_STA, M_INDIRECTX, 6}, {0x91, K_STA, M_INDIRECTY, 6},
+			{0x86, K_STX, M_ZP, 3}, {0x96, K_STX, M_ZPY, 4}, {0x8E, K_STX, M_ABSOLUTE, 4},
+			{0x84, K_STY, M_ZP, 3}, {0x94, K_STY, M_ZPX, 4}, {0x8C, K_STY, M_ABSOLUTE, 4},
+			{0xE6, K_INC, M_ZP, 5}, {0xF6, K_INC, M_ZPX, 6}, {0xEE, K_INC, M_ABSOLUTE, 6}, {0xFE, K_INC, M_ABSOLUTEX, 7},
+			{0xC6, K_DEC, M_ZP, 5}, {0xD6, K_DEC, M_ZPX, 6}, {0xCE, K_DEC, M_ABSOLUTE, 6}, {0xDE, K_DEC, M_ABSOLUTEX, 7},
+			{0x06, K_ASL, M_ZP, 5}, {0x16, K_ASL, M_ZPX, 6}, {0x0E, K_ASL, M_ABSOLUTE, 6}, {0x1E, K_ASL, M_ABSOLUTEX, 7},
+			{0x46, K_LSR, M_ZP, 5}, {0x56, K_LSR, M_ZPX, 6}, {0x4E, K_LSR, M_ABSOLUTE, 6}, {0x5E, K_LSR, M_ABSOLUTEX, 7},
+			{0x26, K_ROL, M_ZP, 5}, {0x36, K_ROL, M_ZPX, 6}, {0x2E, K_ROL, M_ABSOLUTE, 6}, {0x3E, K_ROL, M_ABSOLUTEX, 7},
+			{0x66, K_ROR, M_ZP, 5}, {0x76, K_ROR, M_ZPX, 6}, {0x6E, K_ROR, M_ABSOLUTE, 6}, {0x7E, K_ROR, M_ABSOLUTEX, 7},
+		};
+
+		struct NativeTable
+		{
+			NativeOp op[256];
+
+			NativeTable()
+			{
+				for (int i = 0; i < 256; i++) op[i] = {(uint8_t)i, K_NONE, M_IMPLIED, 0};
+				for (const NativeOp &n : NATIVE_OPS) op[n.opcode] = n;
+			}
+		};
+
+		const NativeTable native;
+
+		// Slow path of a load, for pages that are not plain memory
+		uint8_t jitRead(JitState *state, uint32_t address)
+		{
+			return state->bus->read(address);
+		}
+
+		// Every store that is not straight to memory. Returns nonzero if the block has to leave.
+		int jitWrite(JitState *state, uint32_t address, uint32_t byte)
+		{
+			if (state->cache->codePage[address >> 8])
+			{
+				state->cache->invalidatePage(address >> 8);
+				state->leave = 1;
+			}
+			state->bus->write(address, byte);
+			return state->leave;
+		}
+
+		/* Turns one block into a function taking the JitState. N and Z are tracked lazily while
+		   compiling: after most instructions they only exist as the result byte in REG_NZ, and are
+		   folded back into REG_P before anything that needs the whole P register. */
+		class BlockCompiler
+		{
+		private:
+			Assembler &a;
+			arx65::bus::Bus *bus;
+			BlockCache *cache;
+			bool checked;
+
+			bool nzLazy;
+			int cycles;
+			size_t epilogue;
+
+			// Jumps to take if a store asks the block to leave after the current op
+			std::vector<size_t> leaveJumps;
+
+		public:
+			BlockCompiler(Assembler &a, arx65::bus::Bus *bus, BlockCache *cache, bool checked)
+				: a(a), bus(bus), cache(cache), checked(checked), nzLazy(false), cycles(0), epilogue(0) {}
+
+			void loadRegister(int reg, int32_t offset)
+			{
+				a.rm(0x0FB6, reg, REG_STATE, offset);
+			}
+
+			void storeRegister(int reg, int32_t offset)
+			{
+				a.rm(0x88, reg, REG_STATE, offset, -1, 0, false, true);
+			}
+
+			// Result of an instruction, sets N and Z
+			void result(int reg)
+			{
+				a.rr(0x0FB6, REG_NZ, reg, false, true);
+				nzLazy = true;
+			}
+
+			// Fold the lazy N and Z back into REG_P
+			void materialize()
+			{
+				if (!nzLazy) return;
+				a.rr(0x80, 4, REG_P, false, true);
+				a.byte(~(FLAG_NEGATIVE | FLAG_ZERO) & 0xFF);
+				a.rr(0x0FB6, RAX, REG_NZ, false, true);
+				a.rm(0x0A, REG_P, REG_STATE, OFF_NZ, RAX, 0, false, true);
+				nzLazy = false;
+			}
+
+			// Copy carry from the host CF into REG_P
+			void carry()
+			{
+				a.rr(0x0F92, 0, RAX, false, true);
+				a.rr(0x80, 4, REG_P, false, true);
+				a.byte(~FLAG_CARRY & 0xFF);
+				a.rr(0x08, RAX, REG_P, false, true);
+			}
+
+			void storeState()
+			{
+				storeRegister(REG_A, OFF_A);
+				storeRegister(REG_X, OFF_X);
+				storeRegister(REG_Y, OFF_Y);
+				storeRegister(REG_P, OFF_P);
+			}
+
+			void loadState()
+			{
+				loadRegister(REG_A, OFF_A);
+				loadRegister(REG_X, OFF_X);
+				loadRegister(REG_Y, OFF_Y);
+				loadRegister(REG_P, OFF_P);
+			}
+
+			void setPC(uint16_t pc)
+			{
+				a.mov32(RAX, pc);
+				a.byte(0x66);
+				a.rm(0x89, RAX, REG_STATE, OFF_PC);
+			}
+
+			// Return to the run loop, with pc as the next instruction unless the PC is already set
+			void leave(int32_t pc, int extraCycles, uint32_t completed)
+			{
+				bool wasLazy = nzLazy;
+				materialize();
+				nzLazy = wasLazy;
+
+				storeState();
+				if (pc >= 0) setPC(pc);
+				a.rm(0x81, 0, REG_STATE, OFF_CYCLES, -1, 0, true);
+				a.u32(cycles + extraCycles);
+				a.rm(0xC7, 0, REG_STATE, OFF_COMPLETED);
+				a.u32(completed);
+				a.jmpTo(epilogue);
+			}
+
+			void callHelper(const void *function)
+			{
+				a.rr(0x89, REG_STATE, RDI, true);
+				a.call(function);
+			}
+
+			// Load from a fixed address into eax
+			void loadFixed(uint16_t address)
+			{
+				uint8_t *page = bus->getDirectReadPages()[address >> 8];
+				if (page)
+				{
+					a.mov64(RCX, page + (address & 0xFF));
+					a.rm(0x0FB6, RAX, RCX, 0);
+				}
+				else
+				{
+					a.mov32(RSI, address);
+					callHelper((const void *)&jitRead);
+					a.rr(0x0FB6, RAX, RAX, false, true);
+				}
+			}
+
+			// Load from the address in esi into eax
+			void loadDynamic()
+			{
+				a.rr(0x89, RSI, RAX);
+				a.rr(0xC1, 5, RAX);
+				a.byte(8);
+				a.mov64(RCX, bus->getDirectReadPages());
+				a.rm(0x8B, RCX, RCX, 0, RAX, 3, true);
+				a.rr(0x85, RCX, RCX, true);
+				size_t slow = a.jcc(CC_E);
+				a.rr(0x0FB6, RAX, RSI, false, true);
+				a.rm(0x0FB6, RAX, RCX, 0, RAX);
+				size_t done = a.jmp();
+				a.bind(slow);
+				callHelper((const void *)&jitRead);
+				a.rr(0x0FB6, RAX, RAX, false, true);
+				a.bind(done);
+			}
+
+			// Call the write helper with the address in esi and the byte in edx
+			void storeSlow(bool canLeave)
+			{
+				callHelper((const void *)&jitWrite);
+				if (canLeave)
+				{
+					a.rr(0x85, RAX, RAX);
+					leaveJumps.push_back(a.jcc(CC_NE));
+				}
+			}
+
+			// Store edx to a fixed address
+			void storeFixed(uint16_t address, bool canLeave)
+			{
+				uint8_t *page = bus->getDirectWritePages()[address >> 8];
+				size_t slow = 0, done = 0;
+
+				if (page && !checked)
+				{
+					a.mov64(RCX, &cache->codePage[address >> 8]);
+					a.rm(0x80, 7, RCX, 0);
+					a.byte(0);
+					slow = a.jcc(CC_NE);
+					a.mov64(RCX, page + (address & 0xFF));
+					a.rm(0x88, RDX, RCX, 0);
+					done = a.jmp();
+					a.bind(slow);
+				}
+
+				a.mov32(RSI, address);
+				storeSlow(canLeave);
+				if (done) a.bind(done);
+			}
+
+			// Store edx to the address in esi
+			void storeDynamic(bool canLeave)
+			{
+				size_t done = 0;
+
+				if (!checked)
+				{
+					a.rr(0x89, RSI, RAX);
+					a.rr(0xC1, 5, RAX);
+					a.byte(8);
+					a.mov64(RCX, cache->codePage);
+					a.rm(0x80, 7, RCX, 0, RAX);
+					a.byte(0);
+					size_t code = a.jcc(CC_NE);
+					a.mov64(RCX, bus->getDirectWritePages());
+					a.rm(0x8B, RCX, RCX, 0, RAX, 3, true);
+					a.rr(0x85, RCX, RCX, true);
+					size_t device = a.jcc(CC_E);
+					a.rr(0x0FB6, RAX, RSI, false, true);
+					a.rm(0x88, RDX, RCX, 0, RAX);
+					done = a.jmp();
+					a.bind(code);
+					a.bind(device);
+				}
+
+				storeSlow(canLeave);
+				if (done) a.bind(done);
+			}
+
+			// Add a cycle if the base address in eax and the indexed address in esi are in different pages
+			void pageCross()
+			{
+				a.rr(0x31, RSI, RAX);
+				a.rr(0xF7, 0, RAX);
+				a.u32(0xFF00);
+				a.rr(0x0F95, 0, RAX, false, true);
+				a.rr(0x0FB6, RAX, RAX, false, true);
+				a.rm(0x01, RAX, REG_STATE, OFF_CYCLES, -1, 0, true);
+			}
+
+			// Read a pointer from the zero page address in esi into esi, wrapping around within the zero page
+			void pointerDynamic()
+			{
+				a.rm(0x89, RSI, REG_STATE, OFF_ADDRESS);
+				loadDynamic();
+				storeRegister(RAX, OFF_SCRATCH);
+				a.rm(0x8B, RSI, REG_STATE, OFF_ADDRESS);
+				a.rr(0xFE, 0, RSI, false, true);
+				a.rr(0x0FB6, RSI, RSI, false, true);
+				loadDynamic();
+				a.rr(0xC1, 4, RAX);
+				a.byte(8);
+				loadRegister(RCX, OFF_SCRATCH);
+				a.rr(0x09, RCX, RAX);
+				a.rr(0x89, RAX, RSI);
+			}
+
+			// Work out the address of a memory operand. Fixed addresses are returned, the rest end up in esi.
+			// With penalty, crossing a page in the indexed modes costs a cycle as it does for loads.
+			bool address(Mode mode, uint16_t operand, uint16_t &fixed, bool penalty)
+			{
+				switch (mode)
+				{
+				case M_ZP:
+					fixed = operand & 0xFF;
+					return true;
+
+				case M_ABSOLUTE:
+					fixed = operand;
+					return true;
+
+				case M_ZPX:
+				case M_ZPY:
+				case M_ABSOLUTEX:
+				case M_ABSOLUTEY:
+					a.rr(0x0FB6, RSI, mode == M_ZPX || mode == M_ABSOLUTEX ? REG_X : REG_Y, false, true);
+					a.rr(0x81, 0, RSI);
+					a.u32(mode == M_ZPX || mode == M_ZPY ? operand & 0xFF : operand);
+					a.rr(0x81, 4, RSI);
+					a.u32(mode == M_ZPX || mode == M_ZPY ? 0xFF : 0xFFFF);
+					if (penalty && (mode == M_ABSOLUTEX || mode == M_ABSOLUTEY))
+					{
+						a.mov32(RAX, operand);
+						pageCross();
+					}
+					return false;
+
+				case M_INDIRECTX:
+					a.rr(0x0FB6, RSI, REG_X, false, true);
+					a.rr(0x80, 0, RSI, false, true);
+					a.byte(operand & 0xFF);
+					a.rr(0x0FB6, RSI, RSI, false, true);
+					pointerDynamic();
+					return false;
+
+				case M_INDIRECTY:
+					// The pointer's high byte wraps around to $00 like the low byte's address
+					loadFixed(operand & 0xFF);
+					storeRegister(RAX, OFF_SCRATCH);
+					loadFixed((operand + 1) & 0xFF);
+					a.rr(0xC1, 4, RAX);
+					a.byte(8);
+					loadRegister(RCX, OFF_SCRATCH);
+					a.rr(0x09, RCX, RAX);
+					a.rr(0x0FB6, RCX, REG_Y, false, true);
+					a.rr(0x01, RAX, RCX);
+					a.rr(0x0FB7, RSI, RCX);
+					if (penalty) pageCross();
+					return false;
+
+				default:
+					return false;
+				}
+			}
+
+			// Load a memory or immediate operand into eax
+			void load(Mode mode, uint16_t operand)
+			{
+				uint16_t fixed;
+				if (mode == M_IMMEDIATE) a.mov32(RAX, operand & 0xFF);
+				else if (address(mode, operand, fixed, true)) loadFixed(fixed);
+				else loadDynamic();
+			}
+
+			// Store edx to a memory operand whose address is fixed or already in esi
+			void store(bool isFixed, uint16_t fixed, bool canLeave)
+			{
+				if (isFixed) storeFixed(fixed, canLeave);
+				else storeDynamic(canLeave);
+			}
+
+			void compare(int reg)
+			{
+				a.rr(0x88, reg, RCX, false, true);
+				a.rr(0x28, RAX, RCX, false, true);
+				a.rr(0x0F93, 0, RDX, false, true);
+				a.rr(0x80, 4, REG_P, false, true);
+				a.byte(~FLAG_CARRY & 0xFF);
+				a.rr(0x08, RDX, REG_P, false, true);
+				result(RCX);
+			}
+
+			// Push edx. The stack pointer moves before the store so a store that leaves is complete.
+			void push(bool canLeave)
+			{
+				loadRegister(RSI, OFF_SP);
+				a.rr(0x81, 1, RSI);
+				a.u32(0x100);
+				a.rm(0xFE, 1, REG_STATE, OFF_SP);
+				storeDynamic(canLeave);
+			}
+
+			// Pull into eax
+			void pull()
+			{
+				a.rm(0xFE, 0, REG_STATE, OFF_SP);
+				loadRegister(RSI, OFF_SP);
+				a.rr(0x81, 1, RSI);
+				a.u32(0x100);
+				loadDynamic();
+			}
+
+			// Branch on a flag, as the last op of a block
+			void branch(uint8_t opcode, uint16_t pc, int8_t offset, uint32_t completed)
+			{
+				int flag = opcode >> 6;
+				bool onSet = opcode & 0x20;
+				int taken;
+
+				if ((flag == 0 || flag == 3) && nzLazy)
+				{
+					// N or Z straight from the last result
+					a.rr(0x84, REG_NZ, REG_NZ, false, true);
+					taken = flag == 0 ? (onSet ? CC_S : CC_NS) : (onSet ? CC_E : CC_NE);
+				}
+				else
+				{
+					const uint8_t masks[4] = {FLAG_NEGATIVE, FLAG_OVERFLOW, FLAG_CARRY, FLAG_ZERO};
+					a.rr(0xF6, 0, REG_P, false, true);
+					a.byte(masks[flag]);
+					taken = onSet ? CC_NE : CC_E;
+				}
+
+				// A taken branch costs one more cycle when it lands in another page
+				uint16_t next = pc + 2, target = next + offset;
+				size_t jump = a.jcc(taken);
+				leave(next, 2, completed);
+				a.bind(jump);
+				leave(target, (target ^ next) & 0xFF00 ? 4 : 3, completed);
+			}
+
+			// Hand one op to the interpreter
+			void interpret(const DecodedOp &op, uint16_t pc, bool last, uint32_t completed)
+			{
+				materialize();
+				storeState();
+				setPC(pc);
+				a.rr(0x89, REG_STATE, RDI, true);
+				a.mov64(RSI, &op);
+				a.call((const void *)&jitInterpret);
+				a.byte(0x48);
+				a.byte(0x98);
+				a.rm(0x01, RAX, REG_STATE, OFF_CYCLES, -1, 0, true);
+				loadState();
+
+				if (last)
+				{
+					leave(-1, 0, completed);
+				}
+				else
+				{
+					a.rm(0x80, 7, REG_STATE, offsetof(JitState, leave));
+					a.byte(0);
+					leaveJumps.push_back(a.jcc(CC_NE));
+				}
+			}
+
+			// Compile an op that has a native version. Returns true if it ended the block.
+			bool compileNative(const NativeOp &n, uint16_t operand)
+			{
+				int reg = 0;
+				uint16_t fixed = 0;
+				bool isFixed;
+
+				switch (n.kind)
+				{
+				case K_LDA: case K_LDX: case K_LDY:
+					reg = n.kind == K_LDA ? REG_A : n.kind == K_LDX ? REG_X : REG_Y;
+					load(n.mode, operand);
+					a.rr(0x88, RAX, reg, false, true);
+					result(reg);
+					break;
+
+				case K_AND: case K_ORA: case K_EOR:
+					load(n.mode, operand);
+					a.rr(n.kind == K_AND ? 0x20 : n.kind == K_ORA ? 0x08 : 0x30, RAX, REG_A, false, true);
+					result(REG_A);
+					break;
+
+				case K_CMP: case K_CPX: case K_CPY:
+					load(n.mode, operand);
+					compare(n.kind == K_CMP ? REG_A : n.kind == K_CPX ? REG_X : REG_Y);
+					break;
+
+				case K_STA: case K_STX: case K_STY:
+					reg = n.kind == K_STA ? REG_A : n.kind == K_STX ? REG_X : REG_Y;
+					isFixed = address(n.mode, operand, fixed, false);
+					a.rr(0x0FB6, RDX, reg, false, true);
+					store(isFixed, fixed, true);
+					break;
+
+				case K_INC: case K_DEC: case K_ASL: case K_LSR: case K_ROL: case K_ROR:
+					isFixed = address(n.mode, operand, fixed, false);
+					if (isFixed)
+					{
+						loadFixed(fixed);
+					}
+					else
+					{
+						a.rm(0x89, RSI, REG_STATE, OFF_ADDRESS);
+						loadDynamic();
+						a.rm(0x8B, RSI, REG_STATE, OFF_ADDRESS);
+					}
+
+					a.rr(0x89, RAX, RDX);
+					if (n.kind == K_ROL || n.kind == K_ROR)
+					{
+						a.rr(0x0FBA, 4, REG_P);
+						a.byte(0);
+					}
+
+					switch (n.kind)
+					{
+					case K_INC: a.rr(0xFE, 0, RDX, false, true); break;
+					case K_DEC: a.rr(0xFE, 1, RDX, false, true); break;
+					case K_ASL: a.rr(0xD0, 4, RDX, false, true); break;
+					case K_LSR: a.rr(0xD0, 5, RDX, false, true); break;
+					case K_ROL: a.rr(0xD0, 2, RDX, false, true); break;
+					default: a.rr(0xD0, 3, RDX, false, true); break;
+					}
+
+					if (n.kind != K_INC && n.kind != K_DEC) carry();
+					result(RDX);
+					store(isFixed, fixed, true);
+					break;
+
+				default:
+					break;
+				}
+
+				cycles += n.cycles;
+				return false;
+			}
+
+			// Compile an implied or control flow op. Returns 0 if it has no native version, 1 if it
+			// was compiled and the block goes on, 2 if it ended the block.
+			int compileOther(const DecodedOp &op, uint16_t pc, uint32_t completed)
+			{
+				switch (op.opcode)
+				{
+				case 0xAA: a.rr(0x88, REG_A, REG_X, false, true); result(REG_X); break;	// TAX
+				case 0xA8: a.rr(0x88, REG_A, REG_Y, false, true); result(REG_Y); break;	// TAY
+				case 0x8A: a.rr(0x88, REG_X, REG_A, false, true); result(REG_A); break;	// TXA
+				case 0x98: a.rr(0x88, REG_Y, REG_A, false, true); result(REG_A); break;	// TYA
+				case 0xBA: loadRegister(REG_X, OFF_SP); result(REG_X); break;				// TSX
+				case 0x9A: storeRegister(REG_X, OFF_SP); break;							// TXS
+				case 0xE8: a.rr(0xFE, 0, REG_X, false, true); result(REG_X); break;		// INX
+				case 0xC8: a.rr(0xFE, 0, REG_Y, false, true); result(REG_Y); break;		// INY
+				case 0xCA: a.rr(0xFE, 1, REG_X, false, true); result(REG_X); break;		// DEX
+				case 0x88: a.rr(0xFE, 1, REG_Y, false, true); result(REG_Y); break;		// DEY
+
+				case 0x18: case 0xD8: case 0x58: case 0xB8:		// CLC, CLD, CLI, CLV
+				case 0x38: case 0xF8: case 0x78:				// SEC, SED, SEI
+				{
+					uint8_t mask = op.opcode == 0x18 || op.opcode == 0x38 ? FLAG_CARRY
+						: op.opcode == 0xD8 || op.opcode == 0xF8 ? FLAG_DECIMAL
+						: op.opcode == 0x58 || op.opcode == 0x78 ? FLAG_INTERRUPT : FLAG_OVERFLOW;
+					bool set = op.opcode == 0x38 || op.opcode == 0xF8 || op.opcode == 0x78;
+					a.rr(0x80, set ? 1 : 4, REG_P, false, true);
+					a.byte(set ? mask : ~mask & 0xFF);
+					break;
+				}
+
+				case 0xEA:	// NOP
+					break;
+
+				case 0x0A: case 0x4A: case 0x2A: case 0x6A:	// ASL, LSR, ROL, ROR A
+					if (op.opcode == 0x2A || op.opcode == 0x6A)
+					{
+						a.rr(0x0FBA, 4, REG_P);
+						a.byte(0);
+					}
+					a.rr(0xD0, op.opcode == 0x0A ? 4 : op.opcode == 0x4A ? 5 : op.opcode == 0x2A ? 2 : 3, REG_A, false, true);
+					carry();
+					result(REG_A);
+					break;
+
+				case 0x48:	// PHA
+					a.rr(0x0FB6, RDX, REG_A, false, true);
+					push(true);
+					cycles += 1;
+					break;
+
+				case 0x08:	// PHP
+					materialize();
+					a.rr(0x0FB6, RDX, REG_P, false, true);
+					a.rr(0x81, 1, RDX);
+					a.u32(0x20 | FLAG_BRK);
+					push(true);
+					cycles += 1;
+					break;
+
+				case 0x68:	// PLA
+					pull();
+					a.rr(0x88, RAX, REG_A, false, true);
+					result(REG_A);
+					cycles += 2;
+					break;
+
+				case 0x28:	// PLP
+					pull();
+					a.rr(0x80, 1, RAX, false, true);
+					a.byte(0x20);
+					a.rr(0x88, RAX, REG_P, false, true);
+					nzLazy = false;
+					cycles += 2;
+					break;
+
+				case 0x4C:	// JMP
+					leave(op.operand, 3, completed);
+					return 2;
+
+				case 0x20:	// JSR, the block ends here anyway so the pushes never leave early
+					a.mov32(RDX, (uint16_t)(pc + 2) >> 8);
+					push(false);
+					a.mov32(RDX, (pc + 2) & 0xFF);
+					push(false);
+					leave(op.operand, 6, completed);
+					return 2;
+
+				case 0x60:	// RTS
+					pull();
+					storeRegister(RAX, OFF_SCRATCH);
+					pull();
+					a.rr(0xC1, 4, RAX);
+					a.byte(8);
+					loadRegister(RCX, OFF_SCRATCH);
+					a.rr(0x09, RCX, RAX);
+					a.rr(0xFF, 0, RAX);
+					a.byte(0x66);
+					a.rm(0x89, RAX, REG_STATE, OFF_PC);
+					leave(-1, 6, completed);
+					return 2;
+
+				case 0x10: case 0x30: case 0x50: case 0x70: case 0x90: case 0xB0: case 0xD0: case 0xF0:
+					branch(op.opcode, pc, (int8_t)op.operand, completed);
+					return 2;
+
+				default:
+					return 0;
+				}
+
+				cycles += 2;
+				return 1;
+			}
+
+			// Generate the whole block, returning its entry point
+			uint8_t *compile(const Block *block)
+			{
+				// Shared exit first, so every leave() can jump back to it
+				epilogue = a.position();
+				a.rr(0x83, 0, RSP, true);
+				a.byte(8);
+				const int saved[] = {R15, R14, R13, R12, RBP, RBX};
+				for (int reg : saved) a.pop(reg);
+				a.byte(0xC3);
+
+				uint8_t *entry = a.at;
+				for (int i = 5; i >= 0; i--) a.push(saved[i]);
+				a.rr(0x83, 5, RSP, true);
+				a.byte(8);
+				a.rr(0x89, RDI, REG_STATE, true);
+				loadState();
+
+				uint16_t pc = block->start;
+				for (size_t i = 0; i < block->ops.size(); i++)
+				{
+					const DecodedOp &op = block->ops[i];
+					bool last = i + 1 == block->ops.size();
+					uint16_t next = pc + op.length;
+					leaveJumps.clear();
+
+					const NativeOp &n = native.op[op.opcode];
+					int done = n.kind != K_NONE ? (compileNative(n, op.operand), 1) : compileOther(op, pc, i + 1);
+
+					if (done == 2) break;
+					if (done == 0) interpret(op, pc, last, i + 1);
+					else if (last) leave(next, 0, i + 1);
+
+					if (!leaveJumps.empty())
+					{
+						size_t over = a.jmp();
+						for (size_t jump : leaveJumps) a.bind(jump);
+						leave(next, 0, i + 1);
+						a.bind(over);
+					}
+
+					pc = next;
+				}
+
+				return entry;
+			}
+		};
+	}
+#endif
+
+	Jit::Jit(arx65::bus::Bus *bus, BlockCache *cache) : logger(bus), replay(bus, logger.log)
+	{
+		this->bus = bus;
+		this->cache = cache;
+		code = nullptr;
+		capacity = 0;
+		used = 0;
+		mapVersion = bus->getMapVersion();
+		loggingBus.attach(&logger);
+		replayBus.attach(&replay);
+
+		state = {};
+		state.bus = bus;
+		state.cache = cache;
+		memcpy(state.nz, NZ_FLAGS.flags, sizeof(state.nz));
+
+#ifdef ARX65_JIT_X86_64
+		capacity = 4 << 20;
+		void *memory = mmap(nullptr, capacity, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (memory == MAP_FAILED) capacity = 0;
+		else code = (uint8_t *)memory;
+#endif
+	}
+
+	Jit::~Jit()
+	{
+#ifdef ARX65_JIT_X86_64
+		if (code) munmap(code, capacity);
+#endif
+	}
+
+	bool Jit::isSupported()
+	{
+#ifdef ARX65_JIT_X86_64
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	bool Jit::compile(Block *block)
+	{
+#ifdef ARX65_JIT_X86_64
+		if (code == nullptr) return false;
+
+		// Code memory is never writable and executable at the same time. Only the pages a block can
+		// reach are opened up, which is far more than the longest block needs.
+		uint8_t *start = code + (used & ~(size_t)0xFFF);
+		size_t window = std::min(capacity - (start - code), (size_t)64 << 10);
+		if (mprotect(start, window, PROT_READ | PROT_WRITE) != 0) return false;
+
+		Assembler a(code + used, start + window);
+		BlockCompiler compiler(a, bus, cache, isChecking());
+		uint8_t *entry = compiler.compile(block);
+		bool fits = !a.full();
+		if (fits)
+		{
+			block->native = entry;
+			used += a.position();
+		}
+
+		mprotect(start, window, PROT_READ | PROT_EXEC);
+		return fits;
+#else
+		return false;
+#endif
+	}
+
+	void Jit::reset()
+	{
+		used = 0;
+		mapVersion = bus->getMapVersion();
+	}
+
+	bool Jit::isStale()
+	{
+		return mapVersion != bus->getMapVersion();
+	}
+
+	void Jit::setChecking(bool checking)
+	{
+		state.bus = checking ? &loggingBus : bus;
+	}
+
+	bool Jit::isChecking()
+	{
+		return state.bus == &loggingBus;
+	}
+
+	std::vector<JitAccess> &Jit::getLog()
+	{
+		return logger.log;
+	}
+
+	JitReplay &Jit::getReplay()
+	{
+		return replay;
+	}
+
+	arx65::bus::Bus *Jit::getReplayBus()
+	{
+		return &replayBus;
+	}
+}
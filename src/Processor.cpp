@@ -1,1692 +1,1736 @@
 #include "Processor.h"
-
-/* Simplify bus functions to just read and write. */
-using arx65::bus::read;
-using arx65::bus::write;
+#include "Jit.h"
 
 namespace arx65::cpu
 {
-	// Set of register info 
-	RegisterSet R;
-
-	// Array of function pointers, one for each possible instruction
-	int (*instruction[256])();
-
-	RegisterSet *getRegisters()
-	{
-		return &R;
+	/* Every legal opcode as the operation and the addressing mode it is specialized for. Expanded to
+	   build the handler tables and the cases of the switch core. BRK is listed as immediate since
+	   the byte after it is skipped like an operand. */
+#define OPCODE_LIST(X) \
+	X(0x69, ADC, IMMEDIATE) \
+	X(0x65, ADC, ZP) \
+	X(0x75, ADC, ZPX) \
+	X(0x6D, ADC, ABSOLUTE) \
+	X(0x7D, ADC, ABSOLUTEX) \
+	X(0x79, ADC, ABSOLUTEY) \
+	X(0x61, ADC, INDIRECTX) \
+	X(0x71, ADC, INDIRECTY) \
+	X(0x29, AND, IMMEDIATE) \
+	X(0x25, AND, ZP) \
+	X(0x35, AND, ZPX) \
+	X(0x2D, AND, ABSOLUTE) \
+	X(0x3D, AND, ABSOLUTEX) \
+	X(0x39, AND, ABSOLUTEY) \
+	X(0x21, AND, INDIRECTX) \
+	X(0x31, AND, INDIRECTY) \
+	X(0x0A, ASL, ACCUMULATOR) \
+	X(0x06, ASL, ZP) \
+	X(0x16, ASL, ZPX) \
+	X(0x0E, ASL, ABSOLUTE) \
+	X(0x1E, ASL, ABSOLUTEX) \
+	X(0x90, BCC, RELATIVE) \
+	X(0xB0, BCS, RELATIVE) \
+	X(0xF0, BEQ, RELATIVE) \
+	X(0x30, BMI, RELATIVE) \
+	X(0xD0, BNE, RELATIVE) \
+	X(0x10, BPL, RELATIVE) \
+	X(0x50, BVC, RELATIVE) \
+	X(0x70, BVS, RELATIVE) \
+	X(0x24, BIT, ZP) \
+	X(0x2C, BIT, ABSOLUTE) \
+	X(0x00, BRK, IMMEDIATE) \
+	X(0x18, CLC, IMPLIED) \
+	X(0xD8, CLD, IMPLIED) \
+	X(0x58, CLI, IMPLIED) \
+	X(0xB8, CLV, IMPLIED) \
+	X(0xC9, CMP, IMMEDIATE) \
+	X(0xC5, CMP, ZP) \
+	X(0xD5, CMP, ZPX) \
+	X(0xCD, CMP, ABSOLUTE) \
+	X(0xDD, CMP, ABSOLUTEX) \
+	X(0xD9, CMP, ABSOLUTEY) \
+	X(0xC1, CMP, INDIRECTX) \
+	X(0xD1, CMP, INDIRECTY) \
+	X(0xE0, CPX, IMMEDIATE) \
+	X(0xE4, CPX, ZP) \
+	X(0xEC, CPX, ABSOLUTE) \
+	X(0xC0, CPY, IMMEDIATE) \
+	X(0xC4, CPY, ZP) \
+	X(0xCC, CPY, ABSOLUTE) \
+	X(0xC6, DEC, ZP) \
+	X(0xD6, DEC, ZPX) \
+	X(0xCE, DEC, ABSOLUTE) \
+	X(0xDE, DEC, ABSOLUTEX) \
+	X(0xCA, DEX, IMPLIED) \
+	X(0x88, DEY, IMPLIED) \
+	X(0x49, EOR, IMMEDIATE) \
+	X(0x45, EOR, ZP) \
+	X(0x55, EOR, ZPX) \
+	X(0x4D, EOR, ABSOLUTE) \
+	X(0x5D, EOR, ABSOLUTEX) \
+	X(0x59, EOR, ABSOLUTEY) \
+	X(0x41, EOR, INDIRECTX) \
+	X(0x51, EOR, INDIRECTY) \
+	X(0xE6, INC, ZP) \
+	X(0xF6, INC, ZPX) \
+	X(0xEE, INC, ABSOLUTE) \
+	X(0xFE, INC, ABSOLUTEX) \
+	X(0xE8, INX, IMPLIED) \
+	X(0xC8, INY, IMPLIED) \
+	X(0x4C, JMP, ABSOLUTE) \
+	X(0x6C, JMP, INDIRECT) \
+	X(0x20, JSR, ABSOLUTE) \
+	X(0xA9, LDA, IMMEDIATE) \
+	X(0xA5, LDA, ZP) \
+	X(0xB5, LDA, ZPX) \
+	X(0xAD, LDA, ABSOLUTE) \
+	X(0xBD, LDA, ABSOLUTEX) \
+	X(0xB9, LDA, ABSOLUTEY) \
+	X(0xA1, LDA, INDIRECTX) \
+	X(0xB1, LDA, INDIRECTY) \
+	X(0xA2, LDX, IMMEDIATE) \
+	X(0xA6, LDX, ZP) \
+	X(0xB6, LDX, ZPY) \
+	X(0xAE, LDX, ABSOLUTE) \
+	X(0xBE, LDX, ABSOLUTEY) \
+	X(0xA0, LDY, IMMEDIATE) \
+	X(0xA4, LDY, ZP) \
+	X(0xB4, LDY, ZPX) \
+	X(0xAC, LDY, ABSOLUTE) \
+	X(0xBC, LDY, ABSOLUTEX) \
+	X(0x4A, LSR, ACCUMULATOR) \
+	X(0x46, LSR, ZP) \
+	X(0x56, LSR, ZPX) \
+	X(0x4E, LSR, ABSOLUTE) \
+	X(0x5E, LSR, ABSOLUTEX) \
+	X(0xEA, NOP, IMPLIED) \
+	X(0x09, ORA, IMMEDIATE) \
+	X(0x05, ORA, ZP) \
+	X(0x15, ORA, ZPX) \
+	X(0x0D, ORA, ABSOLUTE) \
+	X(0x1D, ORA, ABSOLUTEX) \
+	X(0x19, ORA, ABSOLUTEY) \
+	X(0x01, ORA, INDIRECTX) \
+	X(0x11, ORA, INDIRECTY) \
+	X(0x48, PHA, IMPLIED) \
+	X(0x08, PHP, IMPLIED) \
+	X(0x68, PLA, IMPLIED) \
+	X(0x28, PLP, IMPLIED) \
+	X(0x2A, ROL, ACCUMULATOR) \
+	X(0x26, ROL, ZP) \
+	X(0x36, ROL, ZPX) \
+	X(0x2E, ROL, ABSOLUTE) \
+	X(0x3E, ROL, ABSOLUTEX) \
+	X(0x6A, ROR, ACCUMULATOR) \
+	X(0x66, ROR, ZP) \
+	X(0x76, ROR, ZPX) \
+	X(0x6E, ROR, ABSOLUTE) \
+	X(0x7E, ROR, ABSOLUTEX) \
+	X(0x40, RTI, IMPLIED) \
+	X(0x60, RTS, IMPLIED) \
+	X(0xE9, SBC, IMMEDIATE) \
+	X(0xE5, SBC, ZP) \
+	X(0xF5, SBC, ZPX) \
+	X(0xED, SBC, ABSOLUTE) \
+	X(0xFD, SBC, ABSOLUTEX) \
+	X(0xF9, SBC, ABSOLUTEY) \
+	X(0xE1, SBC, INDIRECTX) \
+	X(0xF1, SBC, INDIRECTY) \
+	X(0x38, SEC, IMPLIED) \
+	X(0xF8, SED, IMPLIED) \
+	X(0x78, SEI, IMPLIED) \
+	X(0x85, STA, ZP) \
+	X(0x95, STA, ZPX) \
+	X(0x8D, STA, ABSOLUTE) \
+	X(0x9D, STA, ABSOLUTEX) \
+	X(0x99, STA, ABSOLUTEY) \
+	X(0x81, STA, INDIRECTX) \
+	X(0x91, STA, INDIRECTY) \
+	X(0x86, STX, ZP) \
+	X(0x96, STX, ZPY) \
+	X(0x8E, STX, ABSOLUTE) \
+	X(0x84, STY, ZP) \
+	X(0x94, STY, ZPX) \
+	X(0x8C, STY, ABSOLUTE) \
+	X(0xAA, TAX, IMPLIED) \
+	X(0xA8, TAY, IMPLIED) \
+	X(0xBA, TSX, IMPLIED) \
+	X(0x8A, TXA, IMPLIED) \
+	X(0x9A, TXS, IMPLIED) \
+	X(0x98, TYA, IMPLIED)
+
+	// Bytes taken by an instruction, opcode included
+	constexpr uint8_t modeLength(Mode mode)
+	{
+		switch (mode)
+		{
+		case MODE_IMPLIED: case MODE_ACCUMULATOR: return 1;
+		case MODE_ABSOLUTE: case MODE_ABSOLUTEX: case MODE_ABSOLUTEY: case MODE_INDIRECT: return 3;
+		default: return 2;
+		}
 	}
 
-	RegisterSet getRegistersCopy()
+	// Modes whose operand is always in the zero page
+	constexpr bool isZeroPage(Mode mode)
 	{
-		return R;
+		return mode == MODE_ZP || mode == MODE_ZPX || mode == MODE_ZPY;
 	}
 
-	int doNextInstruction()
+	// Cycles of an instruction that only reads its operand. Absolute,X, Absolute,Y and (Indirect),Y
+	// take one more when adding the index carries into the high byte.
+	constexpr int readCycles(Mode mode)
 	{
-		return (*instruction[read(R.PC)])();
+		switch (mode)
+		{
+		case MODE_IMMEDIATE: return 2;
+		case MODE_ZP: return 3;
+		case MODE_ZPX: case MODE_ZPY: case MODE_ABSOLUTE: case MODE_ABSOLUTEX: case MODE_ABSOLUTEY: return 4;
+		case MODE_INDIRECTY: return 5;
+		case MODE_INDIRECTX: return 6;
+		default: return 2;
+		}
 	}
 
-	// Push a byte onto the stack.
-	void PushStackGeneral(uint8_t num)
+	// Cycles of a store. The indexed modes always pay for the page crossing.
+	constexpr int storeCycles(Mode mode)
 	{
-		write(0x0100 | ((uint16_t)R.SP), num);
-		--R.SP;
+		switch (mode)
+		{
+		case MODE_ABSOLUTEX: case MODE_ABSOLUTEY: return 5;
+		case MODE_INDIRECTX: case MODE_INDIRECTY: return 6;
+		default: return readCycles(mode);
+		}
 	}
 
-	// Pull a byte back from the stack.
-	uint8_t PullStackGeneral()
+	// Cycles of a read-modify-write instruction
+	constexpr int modifyCycles(Mode mode)
 	{
-		++R.SP;
-		return read(0x0100 | ((uint16_t)R.SP));
+		switch (mode)
+		{
+		case MODE_ACCUMULATOR: return 2;
+		case MODE_ZP: return 5;
+		case MODE_ZPX: case MODE_ABSOLUTE: return 6;
+		default: return 7;
+		}
 	}
 
-	void doNMI() {
-		PushStackGeneral((R.PC >> 8) & 0x00FF);
-		PushStackGeneral((R.PC) & 0x00FF);
-		PushStackGeneral(R.Flags);
-		R.PC = ((uint16_t)read(0xFFFA)) | (((uint16_t)read(0xFFFB)) << 8);
-	}
+	/* Result of a decimal mode ADC or SBC and the N, V, Z and C flags it leaves */
+	typedef struct {
+		uint8_t result;
+		uint8_t flags;
+	} DecimalResult;
 
-	// Reset registers to initial values
-	void doRES()
+	/* Decimal mode ADC and SBC for every carry in, accumulator and operand, as an NMOS 6502 does
+	   them, invalid BCD digits included. Built by the compiler, see "Decimal Mode" by Bruce Clark
+	   on 6502.org for where the flags come from. */
+	struct DecimalTable
 	{
-		R.A = 0;
-		R.X = 0;
-		R.Y = 0;
-		R.SP = 0xFF;
-		R.Flags = FLAG_INTERRUPT | 0x20;
-		R.PC = read(0xFFFC) | (read(0xFFFD) << 8);
-	}
+		DecimalResult adc[2][256][256] = {};
+		DecimalResult sbc[2][256][256] = {};
 
-	void doIRQ() {
-		// Push current PC onto stack, high then low byte. Then push flags
-		if (!(R.Flags & FLAG_INTERRUPT))
+		constexpr DecimalTable()
 		{
-			PushStackGeneral((R.PC >> 8) & 0x00FF);
-			PushStackGeneral((R.PC) & 0x00FF);
-			PushStackGeneral(R.Flags);
-			R.PC = ((uint16_t)read(0xFFFE)) | (((uint16_t)read(0xFFFF)) << 8);
+			for (int c = 0; c < 2; c++)
+			{
+				for (int a = 0; a < 256; a++)
+				{
+					for (int b = 0; b < 256; b++)
+					{
+						// ADC: N and V come from the sum before the high digit is adjusted, Z from the binary sum
+						int low = (a & 0x0F) + (b & 0x0F) + c;
+						if (low >= 0x0A) low = ((low + 0x06) & 0x0F) + 0x10;
+						int sum = (a & 0xF0) + (b & 0xF0) + low;
+						int signedSum = (int8_t)(a & 0xF0) + (int8_t)(b & 0xF0) + low;
+						int adjusted = sum >= 0xA0 ? sum + 0x60 : sum;
+
+						adc[c][a][b].result = adjusted;
+						adc[c][a][b].flags = (sum & FLAG_NEGATIVE)
+							| (signedSum < -128 || signedSum > 127 ? FLAG_OVERFLOW : 0)
+							| (NZ_FLAGS.flags[(a + b + c) & 0xFF] & FLAG_ZERO)
+							| (adjusted >= 0x100 ? FLAG_CARRY : 0);
+
+						// SBC: every flag is the same as in binary mode, only the result is adjusted
+						int difference = a - b - 1 + c;
+						low = (a & 0x0F) - (b & 0x0F) - 1 + c;
+						if (low < 0) low = ((low - 0x06) & 0x0F) - 0x10;
+						int result = (a & 0xF0) - (b & 0xF0) + low;
+						if (result < 0) result -= 0x60;
+
+						sbc[c][a][b].result = result;
+						sbc[c][a][b].flags = NZ_FLAGS.flags[difference & 0xFF]
+							| ((a ^ b) & (a ^ difference) & 0x80 ? FLAG_OVERFLOW : 0)
+							| (difference >= 0 ? FLAG_CARRY : 0);
+					}
+				}
+			}
 		}
-	}
+	};
 
-	int InvalidInstruction()
-	{
-		++R.PC;
-		return 0;
-	}
+	constexpr DecimalTable decimal;
 
-	/* Reolve a direct Zero Page address. (Advances PC + 1) */
-	uint16_t ResolveZP()
+	/* Working state of the processor. Every helper and handler is a member, so the run loop can
+	   execute against a local copy whose registers stay in host registers until it returns.
+	   DECODED contexts run pre-decoded ops from the block cache and take their operands from
+	   the op instead of fetching them through the bus. */
+	template <bool DECODED>
+	struct ContextT
 	{
-		return read(++R.PC);
-	}
+		// Set of register info 
+		RegisterSet R;
 
-	/* Resolve a direct zero page X, with X offset, including wraparound. (Advances PC + 1) */
-	uint16_t ResolveZPX()
-	{
-		return (read(++R.PC) + R.X) & 0x00FF;
-	}
+		// Bus of the Cpu this context belongs to
+		arx65::bus::Bus *bus;
 
-	/* Resolve a direct zero page Y, with Y offset, including wraparound. (Advances PC + 1) */
-	uint16_t ResolveZPY()
-	{
-		return (read(++R.PC) + R.Y) & 0x00FF; // This & might not be necessary since both values are already of uint8_t type
-	}
+		// Zero page and stack ($0000-$01FF) when both are plain RAM, or nullptr to go through the bus
+		uint8_t *lowMemory;
 
-	/* Resolve a direct address (advances PC + 2)*/
-	uint16_t ResolveAbsolute()
-	{
-		return (uint16_t)read(++R.PC) | (((uint16_t)read(++R.PC)) << 8);
-	}
+		// Block cache to tell about writes to cached code, or nullptr when the block core is not in use
+		BlockCache *cache;
 
-	/* Resolve direct address with X offset, and pageCrossed will be appropriately set (advances PC + 2)*/
-	uint16_t ResolveAbsoluteX(bool &pageCrossed)
-	{
-		uint16_t addressBeforeAdding = (uint16_t)read(++R.PC) | (((uint16_t)read(++R.PC)) << 8);
+		// Operand of the op being executed, filled in by the block core
+		uint16_t operand;
 
-		// To determine if a page was crossed, we just see if the most significant byte is bigger
-		pageCrossed = (0xFF00 & (addressBeforeAdding + R.X) > (0xFF00 & addressBeforeAdding));
-		return addressBeforeAdding + R.X;
-	}
+		/* N, Z, C and V as left by the last instruction that set them. Most results overwrite the
+		   flags before anything looks at them, so they are only folded into a byte by flags().
+		   Bit 7 of negative is N, zero is 0 when Z is set, carry is 0 or FLAG_CARRY and overflow
+		   is 0 or FLAG_OVERFLOW. R.Flags only holds the other bits while a context is running. */
+		uint8_t negative, zero, carry, overflow;
 
-	/* Resolve direct address with Y offset, and pageCrossed will be appropriately set (advances PC + 2)*/
-	uint16_t ResolveAbsoluteY(bool &pageCrossed)
-	{
-		uint16_t addressBeforeAdding = (uint16_t)read(++R.PC) | (((uint16_t)read(++R.PC)) << 8);
+		// N and Z from one result
+		void setNZ(uint8_t result)
+		{
+			negative = result;
+			zero = result;
+		}
 
-		// To determine if a page was crossed, we just see if the most significant byte is bigger
-		pageCrossed = (0xFF00 & (addressBeforeAdding + R.Y) > (0xFF00 & addressBeforeAdding));
-		return addressBeforeAdding + R.Y;
-	}
+		uint8_t flags() const
+		{
+			return (R.Flags & ~(FLAG_NEGATIVE | FLAG_ZERO | FLAG_CARRY | FLAG_OVERFLOW))
+				| (negative & FLAG_NEGATIVE) | (zero ? 0 : FLAG_ZERO) | carry | overflow;
+		}
 
-	/* Resolves an indirect address at zero page + X, then resolve. (advances PC + 1) */
-	uint16_t ResolveIndirectX()
-	{
-		uint8_t zpAddress = read(++R.PC + R.X);
-		return ((uint16_t)read(zpAddress)) | ((uint16_t)read(zpAddress + 1) << 8);
-	}
+		void setFlags(uint8_t byte)
+		{
+			R.Flags = byte;
+			negative = byte;
+			zero = ~byte & FLAG_ZERO;
+			carry = byte & FLAG_CARRY;
+			overflow = byte & FLAG_OVERFLOW;
+		}
 
-	/* Resolves an indirect address at zero page, then add Y, then resolve. (advances PC + 1) */
-	uint16_t ResolveIndirectY(bool &pageCrossed)
-	{
-		uint8_t zpAddress = read(++R.PC);
-		uint16_t addressBeforeAdding = ((uint16_t)read(zpAddress)) | ((uint16_t)read(zpAddress + 1) << 8);
+		// The registers with the flags folded back in, for anything outside the context
+		RegisterSet registers() const
+		{
+			RegisterSet r = R;
+			r.Flags = flags();
+			return r;
+		}
 
-		// To determine if a page was crossed, we just see if the most significant byte is bigger
-		pageCrossed = (0xFF00 & (addressBeforeAdding + R.Y) > (0xFF00 & addressBeforeAdding));
-		return addressBeforeAdding + R.Y;
-	}
+		void setRegisters(const RegisterSet &registers)
+		{
+			R = registers;
+			setFlags(registers.Flags);
+		}
 
-	// All ADC instructions call on this one, once the number is retrieved.
-	void ADC_General(uint8_t num)
-	{	
-		uint8_t oldA = R.A;
-		if (R.Flags & FLAG_DECIMAL) 
+		/* Simplify bus functions to just read and write. */
+		uint8_t read(uint16_t address)
 		{
-			uint8_t onesNibble = (R.A & 0x0F) + (num & 0x0F) + (R.Flags & FLAG_CARRY ? 1 : 0);
-			uint8_t tensNibble = ((R.A & 0xF0) >> 4) + ((num & 0xF0) >> 4);
-			
-			if (onesNibble > 0x09)
-			{
-				onesNibble -= 10;
-				++tensNibble;
-			}
+			return bus->read(address);
+		}
+
+		void write(uint16_t address, uint8_t byte)
+		{
+			if (cache && cache->codePage[address >> 8]) cache->invalidatePage(address >> 8);
+			bus->write(address, byte);
+		}
+
+		uint16_t read16(uint16_t address)
+		{
+			return bus->read16(address);
+		}
 
-			bool carried = false;
-			if (tensNibble > 0x09)
+		/* Zero page and stack access. The address must be below $0200. */
+		uint8_t readZP(uint16_t address)
+		{
+			if (lowMemory) return lowMemory[address];
+			return read(address);
+		}
+
+		void writeZP(uint16_t address, uint8_t byte)
+		{
+			if (lowMemory)
 			{
-				tensNibble -= 10;
-				carried = true;
+				if (cache && cache->codePage[address >> 8]) cache->invalidatePage(address >> 8);
+				lowMemory[address] = byte;
 			}
+			else write(address, byte);
+		}
 
-			R.A = ((tensNibble << 4) & 0xF0) | (onesNibble & 0x0F);
-
-			R.Flags &= ~(FLAG_ZERO | FLAG_NEGATIVE | FLAG_CARRY | FLAG_OVERFLOW);
-			R.Flags |= (R.A == 0 ? FLAG_ZERO : 0)
-				| ((0x80 & R.A) ? FLAG_NEGATIVE : 0)
-				| (carried ? FLAG_CARRY : 0)
-				| (((0x80 & oldA) ^ (0x80 & R.A)) ? FLAG_OVERFLOW : 0);
+		/* Fetch the 8 bit operand following the opcode. (Advances PC + 1) */
+		uint8_t Fetch8()
+		{
+			++R.PC;
+			if (DECODED) return (uint8_t)operand;
+			return read(R.PC);
 		}
-		else
+
+		/* Fetch the 16 bit operand following the opcode in one read. (Advances PC + 2) */
+		uint16_t Fetch16()
 		{
-			R.A += num + (R.Flags & FLAG_CARRY ? 1 : 0);
-			
-			R.Flags &= ~(FLAG_ZERO | FLAG_NEGATIVE | FLAG_CARRY | FLAG_OVERFLOW);
-			R.Flags |= (R.A == 0 ? FLAG_ZERO : 0)
-				| ((0x80 & R.A) ? FLAG_NEGATIVE : 0)
-				| (((uint16_t)num + (uint16_t)oldA + (R.Flags & FLAG_CARRY ? 1 : 0) > UINT8_MAX) ? FLAG_CARRY : 0)
-				| (((0x80 & oldA) ^ (0x80 & R.A)) ? FLAG_OVERFLOW : 0);
+			R.PC += 2;
+			if (DECODED) return operand;
+			return read16(R.PC - 1);
 		}
-	}
 
-	void AND_General(uint8_t num)
-	{
-		R.A &= num;
-		R.Flags &= ~(FLAG_ZERO | FLAG_NEGATIVE);
-		R.Flags |= (R.A == 0 ? FLAG_ZERO : 0) | ((0x80 & R.A) ? FLAG_NEGATIVE : 0);
-	}
+		// Push a byte onto the stack.
+		void PushStackGeneral(uint8_t num)
+		{
+			writeZP(0x0100 | ((uint16_t)R.SP), num);
+			--R.SP;
+		}
 
-	void ASL_General(uint8_t &num)
-	{
-		R.Flags &= ~(FLAG_ZERO | FLAG_NEGATIVE | FLAG_CARRY);
-		R.Flags |= (0x80 & num ? FLAG_CARRY : 0);
-		num <<= 1;
-		R.Flags |= (R.A == 0 ? FLAG_ZERO : 0) | ((0x80 & R.A) ? FLAG_NEGATIVE : 0);
-	}
+		// Pull a byte back from the stack.
+		uint8_t PullStackGeneral()
+		{
+			++R.SP;
+			return readZP(0x0100 | ((uint16_t)R.SP));
+		}
 
-	// Call this with all branch tests. Will set PC either way, and return number of cycles for entire branch.
-	int BranchGeneral(bool doBranch)
-	{
-		if (doBranch) {
-			uint16_t oldPC = R.PC + 2;
-			R.PC += (int8_t)read(++R.PC);
-			++R.PC;
-			if (0xFF00 & R.PC != 0xFF00 & oldPC) return 4; // New page
-			return 3; // Success but not a new page
+		// Interrupts push the flags with B clear, and disable further IRQs until the handler returns
+		void doNMI() {
+			PushStackGeneral((R.PC >> 8) & 0x00FF);
+			PushStackGeneral((R.PC) & 0x00FF);
+			PushStackGeneral((flags() & ~FLAG_BRK) | 0x20);
+			R.Flags |= FLAG_INTERRUPT;
+			R.PC = read16(0xFFFA);
 		}
-		R.PC += 2;
-		return 2; // No branch.
-	}
 
-	void BIT_General(uint8_t num)
-	{
-		R.Flags &= ~(FLAG_ZERO | FLAG_OVERFLOW | FLAG_NEGATIVE);
-		R.Flags |= (num & R.A == 0 ? FLAG_ZERO : 0) | (num & 0x40 ? FLAG_OVERFLOW : 0) | (num & 0x80 ? FLAG_NEGATIVE : 0);
-	}
-	
-	void CMP_General(uint8_t reg, uint8_t mem)
-	{
-		R.Flags &= ~(FLAG_CARRY | FLAG_ZERO | FLAG_NEGATIVE);
-		R.Flags |= (reg >= mem ? FLAG_CARRY : 0) | (reg == mem ? FLAG_ZERO : 0) | ((0x80 & (reg - mem)) ? FLAG_NEGATIVE : 0);
-	}
+		// Reset registers to initial values
+		void doRES()
+		{
+			R.A = 0;
+			R.X = 0;
+			R.Y = 0;
+			R.SP = 0xFF;
+			setFlags(FLAG_INTERRUPT | 0x20);
+			R.PC = read16(0xFFFC);
+		}
 
-	void DEC_General(uint8_t &num)
-	{
-		num--;
-		R.Flags &= ~(FLAG_ZERO | FLAG_NEGATIVE);
-		R.Flags |= (num == 0 ? FLAG_ZERO : 0) | ((0x80 & num) ? FLAG_NEGATIVE : 0);
-	}
+		void doIRQ() {
+			// Push current PC onto stack, high then low byte. Then push flags
+			if (!(R.Flags & FLAG_INTERRUPT))
+			{
+				PushStackGeneral((R.PC >> 8) & 0x00FF);
+				PushStackGeneral((R.PC) & 0x00FF);
+				PushStackGeneral((flags() & ~FLAG_BRK) | 0x20);
+				R.Flags |= FLAG_INTERRUPT;
+				R.PC = read16(0xFFFE);
+			}
+		}
 
-	void EOR_General(uint8_t num)
-	{
-		R.A ^= num;
-		R.Flags &= ~(FLAG_ZERO | FLAG_NEGATIVE);
-		R.Flags |= (R.A == 0 ? FLAG_ZERO : 0) | ((0x80 & R.A) ? FLAG_NEGATIVE : 0);
-	}
+		// Undocumented opcodes run as one byte NOPs
+		int InvalidInstruction()
+		{
+			++R.PC;
+			return 2;
+		}
 
-	void INC_General(uint8_t &num)
-	{
-		num++;
-		R.Flags &= ~(FLAG_ZERO | FLAG_NEGATIVE);
-		R.Flags |= (num == 0 ? FLAG_ZERO : 0) | ((0x80 & num) ? FLAG_NEGATIVE : 0);
-	}
+		/* Reolve a direct Zero Page address. (Advances PC + 1) */
+		uint16_t ResolveZP()
+		{
+			return Fetch8();
+		}
 
-	void LD_General(uint8_t &reg, uint8_t num)
-	{
-		reg = num;
-		R.Flags &= ~(FLAG_ZERO | FLAG_NEGATIVE);
-		R.Flags |= (reg == 0 ? FLAG_ZERO : 0) | ((0x80 & reg) ? FLAG_NEGATIVE : 0);
-	}
+		/* Resolve a direct zero page X, with X offset, including wraparound. (Advances PC + 1) */
+		uint16_t ResolveZPX()
+		{
+			return (Fetch8() + R.X) & 0x00FF;
+		}
 
-	void LSR_General(uint8_t &num)
-	{
-		R.Flags &= ~(FLAG_CARRY | FLAG_ZERO | FLAG_NEGATIVE);
-		R.Flags |= (0x01 & num ? FLAG_CARRY : 0);
-		num >>= 1;
-		R.Flags |= (num == 0 ? FLAG_ZERO : 0) | ((0x80 & num) ? FLAG_NEGATIVE : 0);
-	}
+		/* Resolve a direct zero page Y, with Y offset, including wraparound. (Advances PC + 1) */
+		uint16_t ResolveZPY()
+		{
+			return (Fetch8() + R.Y) & 0x00FF;
+		}
 
-	void ORA_General(uint8_t num)
-	{
-		R.A |= num;
-		R.Flags &= ~(FLAG_ZERO | FLAG_NEGATIVE);
-		R.Flags |= (R.A == 0 ? FLAG_ZERO : 0) | ((0x80 & R.A) ? FLAG_NEGATIVE : 0);
-	}
+		/* Resolve a direct address (advances PC + 2)*/
+		uint16_t ResolveAbsolute()
+		{
+			return Fetch16();
+		}
 
-	void ROL_General(uint8_t &num)
-	{
-		bool oldCarry = R.Flags & FLAG_CARRY;
+		/* Add an index to a base address. pageCrossed is set when the index carried into the high byte,
+		   which costs the 6502 an extra cycle on reads. */
+		uint16_t Indexed(uint16_t base, uint8_t index, bool &pageCrossed)
+		{
+			uint16_t address = base + index;
+			pageCrossed = (address ^ base) & 0xFF00;
+			return address;
+		}
 
-		R.Flags &= ~(FLAG_CARRY | FLAG_ZERO | FLAG_NEGATIVE);
-		R.Flags |= (0x80 & num ? FLAG_CARRY : 0);
+		/* Resolve direct address with X offset, and pageCrossed will be appropriately set (advances PC + 2)*/
+		uint16_t ResolveAbsoluteX(bool &pageCrossed)
+		{
+			return Indexed(Fetch16(), R.X, pageCrossed);
+		}
 
-		// Do operation
-		num <<= 1;
+		/* Resolve direct address with Y offset, and pageCrossed will be appropriately set (advances PC + 2)*/
+		uint16_t ResolveAbsoluteY(bool &pageCrossed)
+		{
+			return Indexed(Fetch16(), R.Y, pageCrossed);
+		}
 
-		// Set new bit 0
-		if (oldCarry) num |= 0x01;
+		/* Read a pointer from the zero page. The high byte comes from $00 when the low byte is at $FF. */
+		uint16_t ReadPointerZP(uint8_t zpAddress)
+		{
+			return ((uint16_t)readZP(zpAddress)) | ((uint16_t)readZP((uint8_t)(zpAddress + 1)) << 8);
+		}
 
-		R.Flags |= (num == 0 ? FLAG_ZERO : 0) | ((0x80 & num) ? FLAG_NEGATIVE : 0);
-	}
+		/* Resolves an indirect address at zero page + X, then resolve. (advances PC + 1) */
+		uint16_t ResolveIndirectX()
+		{
+			return ReadPointerZP(Fetch8() + R.X);
+		}
 
-	void ROR_General(uint8_t &num)
-	{
-		bool oldCarry = R.Flags & FLAG_CARRY;
+		/* Resolves an indirect address at zero page, then add Y, then resolve. (advances PC + 1) */
+		uint16_t ResolveIndirectY(bool &pageCrossed)
+		{
+			return Indexed(ReadPointerZP(Fetch8()), R.Y, pageCrossed);
+		}
 
-		R.Flags &= ~(FLAG_CARRY | FLAG_ZERO | FLAG_NEGATIVE);
-		R.Flags |= (0x01 & num ? FLAG_CARRY : 0);
+		/* Resolve the memory operand of any mode that has one. Only the modes that can cross a page
+		   set pageCrossed. (Advances PC to the last byte of the instruction) */
+		template <Mode MODE>
+		uint16_t Resolve(bool &pageCrossed)
+		{
+			if constexpr (MODE == MODE_ZP) return ResolveZP();
+			else if constexpr (MODE == MODE_ZPX) return ResolveZPX();
+			else if constexpr (MODE == MODE_ZPY) return ResolveZPY();
+			else if constexpr (MODE == MODE_ABSOLUTE) return ResolveAbsolute();
+			else if constexpr (MODE == MODE_ABSOLUTEX) return ResolveAbsoluteX(pageCrossed);
+			else if constexpr (MODE == MODE_ABSOLUTEY) return ResolveAbsoluteY(pageCrossed);
+			else if constexpr (MODE == MODE_INDIRECTX) return ResolveIndirectX();
+			else
+			{
+				static_assert(MODE == MODE_INDIRECTY, "addressing mode has no memory operand");
+				return ResolveIndirectY(pageCrossed);
+			}
+		}
 
-		// Do operation
-		num >>= 1;
+		/* Memory operand access, through the zero page shortcut for the zero page modes. */
+		template <Mode MODE>
+		uint8_t ReadOperand(uint16_t address)
+		{
+			if constexpr (isZeroPage(MODE)) return readZP(address);
+			else return read(address);
+		}
 
-		// Set new bit 7
-		if (oldCarry) num |= 0x80;
+		template <Mode MODE>
+		void WriteOperand(uint16_t address, uint8_t byte)
+		{
+			if constexpr (isZeroPage(MODE)) writeZP(address, byte);
+			else write(address, byte);
+		}
 
-		R.Flags |= (num == 0 ? FLAG_ZERO : 0) | ((0x80 & num) ? FLAG_NEGATIVE : 0);
-	}
+		// Binary addition with carry, shared by ADC and SBC (which adds the complement)
+		void AddBinary(uint8_t num)
+		{
+			uint16_t sum = R.A + num + carry;
+			overflow = (~(R.A ^ num) & (R.A ^ sum) & 0x80) >> 1;
+			carry = sum >> 8;
+			R.A = (uint8_t)sum;
+		}
 
-	void SBC_General(int8_t num)
-	{
-		uint8_t oldA = R.A;
-		if (R.Flags & FLAG_DECIMAL)
+		// Decimal mode ADC and SBC, looked up in their table
+		void DecimalGeneral(const DecimalResult &entry)
 		{
-			int8_t onesNibble = (R.A & 0x0F) - (num & 0x0F) - (R.Flags & FLAG_CARRY ? 1 : 0);
-			int8_t tensNibble = ((R.A & 0xF0) >> 4) - ((num & 0xF0) >> 4);
+			R.A = entry.result;
+			negative = entry.flags;
+			zero = ~entry.flags & FLAG_ZERO;
+			carry = entry.flags & FLAG_CARRY;
+			overflow = entry.flags & FLAG_OVERFLOW;
+		}
 
-			if (onesNibble < 0x00)
+		// All ADC instructions call on this one, once the number is retrieved.
+		void ADC_General(uint8_t num)
+		{
+			if (R.Flags & FLAG_DECIMAL) DecimalGeneral(decimal.adc[carry][R.A][num]);
+			else
 			{
-				onesNibble += 10;
-				--tensNibble;
+				AddBinary(num);
+				setNZ(R.A);
 			}
+		}
 
-			bool carried = false;
-			if (tensNibble < 0x00)
-			{
-				tensNibble += 10;
-				carried = true;
-			}
+		void AND_General(uint8_t num)
+		{
+			R.A &= num;
+			setNZ(R.A);
+		}
 
-			R.A = ((tensNibble << 4) & 0xF0) | (onesNibble & 0x0F);
+		void ASL_General(uint8_t &num)
+		{
+			carry = num >> 7;
+			num <<= 1;
+			setNZ(num);
+		}
 
-			R.Flags &= ~(FLAG_ZERO | FLAG_NEGATIVE | FLAG_CARRY | FLAG_OVERFLOW);
-			R.Flags |= (R.A == 0 ? FLAG_ZERO : 0)
-				| ((0x80 & R.A) ? FLAG_NEGATIVE : 0)
-				| (carried ? FLAG_CARRY : 0)
-				| (((0x80 & oldA) ^ (0x80 & R.A)) ? FLAG_OVERFLOW : 0);
+		// Call this with all branch tests. Will set PC either way, and return number of cycles for entire branch.
+		int BranchGeneral(bool doBranch)
+		{
+			int8_t offset = Fetch8();
+			++R.PC;
+			if (!doBranch) return 2; // No branch.
+
+			uint16_t next = R.PC;
+			R.PC += offset;
+			return ((R.PC ^ next) & 0xFF00) ? 4 : 3; // A new page costs one more
 		}
-		else
+
+		void BIT_General(uint8_t num)
 		{
-			R.A -= num - (R.Flags & FLAG_CARRY ? 1 : 0);
+			zero = R.A & num;
+			overflow = num & FLAG_OVERFLOW;
+			negative = num;
+		}
 
-			R.Flags &= ~(FLAG_ZERO | FLAG_NEGATIVE | FLAG_CARRY | FLAG_OVERFLOW);
-			R.Flags |= (R.A == 0 ? FLAG_ZERO : 0)
-				| ((0x80 & R.A) ? FLAG_NEGATIVE : 0)
-				| (((int16_t)oldA - (int16_t)num - (R.Flags & FLAG_CARRY ? 1 : 0) < 0) ? FLAG_CARRY : 0)
-				| (( (0x80 & oldA) ^ (0x80 & R.A)) ? FLAG_OVERFLOW : 0);
+		template <uint8_t RegisterSet::*REG>
+		void CMP_General(uint8_t mem)
+		{
+			carry = R.*REG >= mem;
+			setNZ(R.*REG - mem);
 		}
-	}
 
-	void T_General(uint8_t source, uint8_t &dest)
-	{
-		dest = source;
-		R.Flags &= ~(FLAG_ZERO | FLAG_NEGATIVE);
-		R.Flags |= (dest == 0 ? FLAG_ZERO : 0) | ((0x80 & dest) ? FLAG_NEGATIVE : 0);
-	}
+		void DEC_General(uint8_t &num)
+		{
+			num--;
+			setNZ(num);
+		}
 
-	/*
-	 **** SPECIFIC VERSIONS OF INSTRUCTIONS HERE ****
-	 */
-	int ADC_Immediate()
-	{
-		ADC_General(read(++R.PC));
-		++R.PC;
-		return 2;
-	}
+		void EOR_General(uint8_t num)
+		{
+			R.A ^= num;
+			setNZ(R.A);
+		}
 
-	int ADC_ZP()
-	{
-		ADC_General(read(ResolveZP()));
-		++R.PC;
-		return 3;
-	}
+		void INC_General(uint8_t &num)
+		{
+			num++;
+			setNZ(num);
+		}
 
-	int ADC_ZPX()
-	{
-		ADC_General(read(ResolveZPX()));
-		++R.PC;
-		return 4;
-	}
+		template <uint8_t RegisterSet::*REG>
+		void LD_General(uint8_t num)
+		{
+			R.*REG = num;
+			setNZ(num);
+		}
 
-	int ADC_Absolute()
-	{
-		ADC_General(read(ResolveAbsolute()));
-		++R.PC;
-		return 4;
-	}
+		void LSR_General(uint8_t &num)
+		{
+			carry = num & FLAG_CARRY;
+			num >>= 1;
+			setNZ(num);
+		}
 
-	int ADC_AbsoluteX()
-	{
-		bool pageCrossed;
-		ADC_General(read(ResolveAbsoluteX(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 5 : 4;
-	}
+		void ORA_General(uint8_t num)
+		{
+			R.A |= num;
+			setNZ(R.A);
+		}
 
-	int ADC_AbsoluteY()
-	{
-		bool pageCrossed;
-		ADC_General(read(ResolveAbsoluteY(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 5 : 4;
-	}
+		void ROL_General(uint8_t &num)
+		{
+			uint8_t oldCarry = carry;
+			carry = num >> 7;
 
-	int ADC_IndirectX()
-	{
-		ADC_General(read(ResolveIndirectX()));
-		++R.PC;
-		return 6;
-	}
+			// Do operation, old carry becomes bit 0
+			num = (num << 1) | oldCarry;
 
-	int ADC_IndirectY()
-	{
-		bool pageCrossed;
-		ADC_General(read(ResolveIndirectY(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 6 : 5;
-	}
+			setNZ(num);
+		}
 
-	int AND_Immediate()
-	{
-		AND_General(read(++R.PC));
-		++R.PC;
-		return 2;
-	}
+		void ROR_General(uint8_t &num)
+		{
+			uint8_t oldCarry = carry;
+			carry = num & FLAG_CARRY;
 
-	int AND_ZP()
-	{
-		AND_General(read(ResolveZP()));
-		++R.PC;
-		return 3;
-	}
+			// Do operation, old carry becomes bit 7
+			num = (num >> 1) | (oldCarry << 7);
 
-	int AND_ZPX()
-	{
-		AND_General(read(ResolveZPX()));
-		++R.PC;
-		return 4;
-	}
+			setNZ(num);
+		}
 
-	int AND_Absolute()
-	{
-		AND_General(read(ResolveAbsolute()));
-		++R.PC;
-		return 4;
-	}
+		void SBC_General(uint8_t num)
+		{
+			if (R.Flags & FLAG_DECIMAL) DecimalGeneral(decimal.sbc[carry][R.A][num]);
+			else
+			{
+				AddBinary(~num);
+				setNZ(R.A);
+			}
+		}
 
-	int AND_AbsoluteX()
-	{
-		bool pageCrossed;
-		AND_General(read(ResolveAbsoluteX(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 5 : 4;
-	}
+		void T_General(uint8_t source, uint8_t &dest)
+		{
+			dest = source;
+			setNZ(dest);
+		}
 
-	int AND_AbsoluteY()
-	{
-		bool pageCrossed;
-		AND_General(read(ResolveAbsoluteY(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 5 : 4;
-	}
+		/*
+		 **** INSTRUCTION KINDS, SPECIALIZED FOR EACH ADDRESSING MODE ****
+		 */
 
-	int AND_IndirectX()
-	{
-		AND_General(read(ResolveIndirectX()));
-		++R.PC;
-		return 6;
-	}
+		// Instructions that only read their operand
+		template <Mode MODE, void (ContextT::*OPERATION)(uint8_t)>
+		int ReadGeneral()
+		{
+			bool pageCrossed = false;
+			if constexpr (MODE == MODE_IMMEDIATE) (this->*OPERATION)(Fetch8());
+			else (this->*OPERATION)(ReadOperand<MODE>(Resolve<MODE>(pageCrossed)));
+			++R.PC;
+			return readCycles(MODE) + pageCrossed;
+		}
 
-	int AND_IndirectY()
-	{
-		bool pageCrossed;
-		AND_General(read(ResolveIndirectY(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 6 : 5;
-	}
+		template <Mode MODE, uint8_t RegisterSet::*REG>
+		int StoreGeneral()
+		{
+			bool pageCrossed = false;
+			WriteOperand<MODE>(Resolve<MODE>(pageCrossed), R.*REG);
+			++R.PC;
+			return storeCycles(MODE);
+		}
 
-	int ASL_Accumulator()
-	{
-		ASL_General(R.A);
-		++R.PC;
-		return 2;
-	}
+		// Read-modify-write, on the accumulator or on memory
+		template <Mode MODE, void (ContextT::*OPERATION)(uint8_t &)>
+		int ModifyGeneral()
+		{
+			if constexpr (MODE == MODE_ACCUMULATOR) (this->*OPERATION)(R.A);
+			else
+			{
+				bool pageCrossed = false;
+				uint16_t address = Resolve<MODE>(pageCrossed);
+				uint8_t num = ReadOperand<MODE>(address);
+				(this->*OPERATION)(num);
+				WriteOperand<MODE>(address, num);
+			}
+			++R.PC;
+			return modifyCycles(MODE);
+		}
 
-	int ASL_ZP()
-	{
-		uint8_t address = ResolveZP();
-		uint8_t num = read(address);
-		ASL_General(num);
-		write(address, num);
-		++R.PC;
-		return 5;
-	}
+		/*
+		 **** SPECIFIC VERSIONS OF INSTRUCTIONS HERE ****
+		 */
+		template <Mode MODE>
+		int ADC()
+		{
+			return ReadGeneral<MODE, &ContextT::ADC_General>();
+		}
 
-	int ASL_ZPX()
-	{
-		uint8_t address = ResolveZPX();
-		uint8_t num = read(address);
-		ASL_General(num);
-		write(address, num);
-		++R.PC;
-		return 6;
-	}
+		template <Mode MODE>
+		int AND()
+		{
+			return ReadGeneral<MODE, &ContextT::AND_General>();
+		}
 
-	int ASL_Absolute()
-	{
-		uint8_t address = ResolveAbsolute();
-		uint8_t num = read(address);
-		ASL_General(num);
-		write(address, num);
-		++R.PC;
-		return 6;
-	}
+		template <Mode MODE>
+		int ASL()
+		{
+			return ModifyGeneral<MODE, &ContextT::ASL_General>();
+		}
 
-	int ASL_AbsoluteX()
-	{
-		bool temp;
-		uint8_t address = ResolveAbsoluteX(temp); // TODO: This doesn't actually need this variable, maybe provide an implementation that ignores new pages.
-		uint8_t num = read(address);
-		ASL_General(num);
-		write(address, num);
-		++R.PC;
-		return 7;
-	}
+		template <Mode MODE>
+		int BCC()
+		{
+			return BranchGeneral(!carry);
+		}
 
-	int BCC()
-	{
-		return BranchGeneral(!(R.Flags & FLAG_CARRY));
-	}
+		template <Mode MODE>
+		int BCS()
+		{
+			return BranchGeneral(carry);
+		}
 
-	int BCS()
-	{
-		return BranchGeneral(R.Flags & FLAG_CARRY);
-	}
+		template <Mode MODE>
+		int BEQ()
+		{
+			return BranchGeneral(!zero);
+		}
 
-	int BEQ()
-	{
-		return BranchGeneral(R.Flags & FLAG_ZERO);
-	}
+		template <Mode MODE>
+		int BIT()
+		{
+			return ReadGeneral<MODE, &ContextT::BIT_General>();
+		}
 
-	int BIT_ZP()
-	{
-		BIT_General(read(ResolveZP()));
-		++R.PC;
-		return 3;
-	}
+		template <Mode MODE>
+		int BMI()
+		{
+			return BranchGeneral(negative & FLAG_NEGATIVE);
+		}
 
-	int BIT_Absolute()
-	{
-		BIT_General(read(ResolveAbsolute()));
-		++R.PC;
-		return 4;
-	}
+		template <Mode MODE>
+		int BNE()
+		{
+			return BranchGeneral(zero);
+		}
 
-	int BMI()
-	{
-		return BranchGeneral(R.Flags & FLAG_NEGATIVE);
-	}
+		template <Mode MODE>
+		int BPL()
+		{
+			return BranchGeneral(!(negative & FLAG_NEGATIVE));
+		}
 
-	int BNE()
-	{
-		return BranchGeneral(!(R.Flags & FLAG_ZERO));
-	}
+		template <Mode MODE>
+		int BRK()
+		{
+			R.PC += 2; // 6502 Claims that BRK is a 1 byte instruction, but see http://nesdev.com/the%20%27B%27%20flag%20&%20BRK%20instruction.txt
 
-	int BPL()
-	{
-		return BranchGeneral(!(R.Flags & FLAG_NEGATIVE));
-	}
+			// Unlike an IRQ this happens with interrupts disabled too, and pushes B set
+			PushStackGeneral((R.PC >> 8) & 0x00FF);
+			PushStackGeneral((R.PC) & 0x00FF);
+			PushStackGeneral(flags() | 0x20 | FLAG_BRK);
+			R.Flags |= FLAG_INTERRUPT;
+			R.PC = read16(0xFFFE);
+			return 7;
+		}
 
-	int BRK()
-	{
-		R.PC += 2; // 6502 Claims that BRK is a 1 byte instruction, but see http://nesdev.com/the%20%27B%27%20flag%20&%20BRK%20instruction.txt
-		R.Flags |= FLAG_BRK;
-		doIRQ();
-		R.Flags |= FLAG_INTERRUPT;
-		return 7;
-	}
+		template <Mode MODE>
+		int BVC()
+		{
+			return BranchGeneral(!overflow);
+		}
 
-	int BVC()
-	{
-		return BranchGeneral(!(R.Flags & FLAG_OVERFLOW));
-	}
+		template <Mode MODE>
+		int BVS()
+		{
+			return BranchGeneral(overflow);
+		}
 
-	int BVS()
-	{
-		return BranchGeneral(R.Flags & FLAG_OVERFLOW);
-	}
+		template <Mode MODE>
+		int CLC()
+		{
+			carry = 0;
+			++R.PC;
+			return 2;
+		}
 
-	int CLC()
-	{
-		R.Flags &= ~FLAG_CARRY;
-		++R.PC;
-		return 2;
-	}
+		template <Mode MODE>
+		int CLD()
+		{
+			R.Flags &= ~FLAG_DECIMAL;
+			++R.PC;
+			return 2;
+		}
 
-	int CLD()
-	{
-		R.Flags &= ~FLAG_DECIMAL;
-		++R.PC;
-		return 2;
-	}
+		template <Mode MODE>
+		int CLI()
+		{
+			R.Flags &= ~FLAG_INTERRUPT;
+			++R.PC;
+			return 2;
+		}
 
-	int CLI()
-	{
-		R.Flags &= ~FLAG_INTERRUPT;
-		++R.PC;
-		return 2;
-	}
+		template <Mode MODE>
+		int CLV()
+		{
+			overflow = 0;
+			++R.PC;
+			return 2;
+		}
 
-	int CLV()
-	{
-		R.Flags &= ~FLAG_OVERFLOW;
-		++R.PC;
-		return 2;
-	}
+		template <Mode MODE>
+		int CMP()
+		{
+			return ReadGeneral<MODE, &ContextT::CMP_General<&RegisterSet::A>>();
+		}
 
-	int CMP_Immediate()
-	{
-		CMP_General(R.A, read(++R.PC));
-		++R.PC;
-		return 2;
-	}
+		template <Mode MODE>
+		int CPX()
+		{
+			return ReadGeneral<MODE, &ContextT::CMP_General<&RegisterSet::X>>();
+		}
 
-	int CMP_ZP()
-	{
-		CMP_General(R.A, read(ResolveZP()));
-		++R.PC;
-		return 3;
-	}
+		template <Mode MODE>
+		int CPY()
+		{
+			return ReadGeneral<MODE, &ContextT::CMP_General<&RegisterSet::Y>>();
+		}
 
-	int CMP_ZPX()
-	{
-		CMP_General(R.A, read(ResolveZPX()));
-		++R.PC;
-		return 4;
-	}
+		template <Mode MODE>
+		int DEC()
+		{
+			return ModifyGeneral<MODE, &ContextT::DEC_General>();
+		}
 
-	int CMP_Absolute()
-	{
-		CMP_General(R.A, read(ResolveAbsolute()));
-		++R.PC;
-		return 4;
-	}
+		template <Mode MODE>
+		int DEX()
+		{
+			DEC_General(R.X);
+			++R.PC;
+			return 2;
+		}
 
-	int CMP_AbsoluteX()
-	{
-		bool pageCrossed;
-		CMP_General(R.A, read(ResolveAbsoluteX(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 5 : 4;
-	}
+		template <Mode MODE>
+		int DEY()
+		{
+			DEC_General(R.Y);
+			++R.PC;
+			return 2;
+		}
 
-	int CMP_AbsoluteY()
-	{
-		bool pageCrossed;
-		CMP_General(R.A, read(ResolveAbsoluteY(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 5 : 4;
-	}
+		template <Mode MODE>
+		int EOR()
+		{
+			return ReadGeneral<MODE, &ContextT::EOR_General>();
+		}
 
-	int CMP_IndirectX()
-	{
-		CMP_General(R.A, read(ResolveIndirectX()));
-		++R.PC;
-		return 6;
-	}
+		template <Mode MODE>
+		int INC()
+		{
+			return ModifyGeneral<MODE, &ContextT::INC_General>();
+		}
 
-	int CMP_IndirectY()
-	{
-		bool pageCrossed;
-		CMP_General(R.A, read(ResolveIndirectY(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 6 : 5;
-	}
+		template <Mode MODE>
+		int INX()
+		{
+			INC_General(R.X);
+			++R.PC;
+			return 2;
+		}
 
-	int CPX_Immediate()
-	{
-		CMP_General(R.X, read(++R.PC));
-		++R.PC;
-		return 2;
-	}
+		template <Mode MODE>
+		int INY()
+		{
+			INC_General(R.Y);
+			++R.PC;
+			return 2;
+		}
 
-	int CPX_ZP()
-	{
-		CMP_General(R.X, read(ResolveZP()));
-		++R.PC;
-		return 3;
-	}
+		template <Mode MODE>
+		int JMP()
+		{
+			uint16_t jmpAddress = Fetch16();
+			if constexpr (MODE == MODE_INDIRECT)
+			{
+				// The high byte of the target is read without carrying into the pointer's high byte
+				uint16_t highAddress = (jmpAddress & 0xFF00) | ((jmpAddress + 1) & 0x00FF);
+				jmpAddress = ((uint16_t)read(jmpAddress)) | ((uint16_t)read(highAddress) << 8);
+			}
+			R.PC = jmpAddress;
+			return MODE == MODE_INDIRECT ? 5 : 3;
+		}
 
-	int CPX_Absolute()
-	{
-		CMP_General(R.X, read(ResolveAbsolute()));
-		++R.PC;
-		return 4;
-	}
+		template <Mode MODE>
+		int JSR()
+		{
+			uint16_t jmpAddress = Fetch16();
+			PushStackGeneral((uint8_t)((R.PC >> 8) & 0x00FF)); // Push High byte onto stack
+			PushStackGeneral((uint8_t)(R.PC & 0x00FF)); // Push low byte onto stack
+			R.PC = jmpAddress; // Jump to new address
+			return 6;
+		}
 
-	int CPY_Immediate()
-	{
-		CMP_General(R.Y, read(++R.PC));
-		++R.PC;
-		return 2;
-	}
+		template <Mode MODE>
+		int LDA()
+		{
+			return ReadGeneral<MODE, &ContextT::LD_General<&RegisterSet::A>>();
+		}
+
+		template <Mode MODE>
+		int LDX()
+		{
+			return ReadGeneral<MODE, &ContextT::LD_General<&RegisterSet::X>>();
+		}
+
+		template <Mode MODE>
+		int LDY()
+		{
+			return ReadGeneral<MODE, &ContextT::LD_General<&RegisterSet::Y>>();
+		}
+
+		template <Mode MODE>
+		int LSR()
+		{
+			return ModifyGeneral<MODE, &ContextT::LSR_General>();
+		}
+
+		template <Mode MODE>
+		int NOP()
+		{
+			++R.PC;
+			return 2;
+		}
 
-	int CPY_ZP()
-	{
-		CMP_General(R.Y, read(ResolveZP()));
-		++R.PC;
-		return 3;
-	}
+		template <Mode MODE>
+		int ORA()
+		{
+			return ReadGeneral<MODE, &ContextT::ORA_General>();
+		}
 
-	int CPY_Absolute()
-	{
-		CMP_General(R.Y, read(ResolveAbsolute()));
-		++R.PC;
-		return 4;
-	}
+		template <Mode MODE>
+		int PHA()
+		{
+			PushStackGeneral(R.A);
+			++R.PC;
+			return 3;
+		}
 
-	int DEC_ZP()
-	{
-		uint16_t address = ResolveZPX();
-		uint8_t num = read(address);
-		DEC_General(num);
-		write(address, num);
-		++R.PC;
-		return 5;
-	}
+		template <Mode MODE>
+		int PHP()
+		{
+			PushStackGeneral(flags() | 0x20 | FLAG_BRK);
+			++R.PC;
+			return 3;
+		}
 
-	int DEC_ZPX()
-	{
-		uint16_t address = ResolveZPX();
-		uint8_t num = read(address);
-		DEC_General(num);
-		write(address, num);
-		++R.PC;
-		return 6;
-	}
+		template <Mode MODE>
+		int PLA()
+		{
+			R.A = PullStackGeneral();
+			setNZ(R.A);
+			++R.PC;
+			return 4;
+		}
 
-	int DEC_Absolute()
-	{
-		uint16_t address = ResolveAbsolute();
-		uint8_t num = read(address);
-		DEC_General(num);
-		write(address, num);
-		++R.PC;
-		return 6;
-	}
+		template <Mode MODE>
+		int PLP()
+		{
+			setFlags(PullStackGeneral() | 0x20);
+			++R.PC;
+			return 4;
+		}
 
-	int DEC_AbsoluteX()
-	{
-		bool t;
-		uint16_t address = ResolveAbsoluteX(t);
-		uint8_t num = read(address);
-		DEC_General(num);
-		write(address, num);
-		++R.PC;
-		return 7;
-	}
+		template <Mode MODE>
+		int ROL()
+		{
+			return ModifyGeneral<MODE, &ContextT::ROL_General>();
+		}
 
-	int DEX()
-	{
-		DEC_General(R.X);
-		++R.PC;
-		return 2;
-	}
+		template <Mode MODE>
+		int ROR()
+		{
+			return ModifyGeneral<MODE, &ContextT::ROR_General>();
+		}
 
-	int DEY()
-	{
-		DEC_General(R.Y);
-		++R.PC;
-		return 2;
-	}
+		template <Mode MODE>
+		int RTI()
+		{
+			setFlags(PullStackGeneral());
+			uint8_t low = PullStackGeneral();
+			R.PC = ((uint16_t)low) | (((uint16_t)PullStackGeneral()) << 8);
+			return 6;
+		}
 
-	int EOR_Immediate()
-	{
-		EOR_General(read(++R.PC));
-		++R.PC;
-		return 2;
-	}
+		template <Mode MODE>
+		int RTS()
+		{
+			uint8_t low = PullStackGeneral();
+			R.PC = (((uint16_t)low) | (((uint16_t)PullStackGeneral()) << 8)) + 1;
+			return 6;
+		}
 
-	int EOR_ZP()
-	{
-		EOR_General(read(ResolveZP()));
-		++R.PC;
-		return 3;
-	}
+		template <Mode MODE>
+		int SBC()
+		{
+			return ReadGeneral<MODE, &ContextT::SBC_General>();
+		}
 
-	int EOR_ZPX()
-	{
-		EOR_General(read(ResolveZPX()));
-		++R.PC;
-		return 4;
-	}
+		template <Mode MODE>
+		int SEC()
+		{
+			carry = FLAG_CARRY;
+			++R.PC;
+			return 2;
+		}
 
-	int EOR_Absolute()
-	{
-		EOR_General(read(ResolveAbsolute()));
-		++R.PC;
-		return 4;
-	}
+		template <Mode MODE>
+		int SED()
+		{
+			R.Flags |= FLAG_DECIMAL;
+			++R.PC;
+			return 2;
+		}
 
-	int EOR_AbsoluteX()
-	{
-		bool pageCrossed;
-		EOR_General(read(ResolveAbsoluteX(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 5 : 4;
-	}
+		template <Mode MODE>
+		int SEI()
+		{
+			R.Flags |= FLAG_INTERRUPT;
+			++R.PC;
+			return 2;
+		}
 
-	int EOR_AbsoluteY()
-	{
-		bool pageCrossed;
-		EOR_General(read(ResolveAbsoluteY(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 5 : 4;
-	}
+		template <Mode MODE>
+		int STA()
+		{
+			return StoreGeneral<MODE, &RegisterSet::A>();
+		}
 
-	int EOR_IndirectX()
-	{
-		EOR_General(read(ResolveIndirectX()));
-		++R.PC;
-		return 6;
-	}
+		template <Mode MODE>
+		int STX()
+		{
+			return StoreGeneral<MODE, &RegisterSet::X>();
+		}
 
-	int EOR_IndirectY()
-	{
-		bool pageCrossed;
-		EOR_General(read(ResolveIndirectY(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 6 : 5;
-	}
+		template <Mode MODE>
+		int STY()
+		{
+			return StoreGeneral<MODE, &RegisterSet::Y>();
+		}
 
-	int INC_ZP()
-	{
-		uint16_t address = ResolveZPX();
-		uint8_t num = read(address);
-		INC_General(num);
-		write(address, num);
-		++R.PC;
-		return 5;
-	}
+		template <Mode MODE>
+		int TAX()
+		{
+			T_General(R.A, R.X);
+			++R.PC;
+			return 2;
+		}
 
-	int INC_ZPX()
-	{
-		uint16_t address = ResolveZPX();
-		uint8_t num = read(address);
-		INC_General(num);
-		write(address, num);
-		++R.PC;
-		return 6;
-	}
+		template <Mode MODE>
+		int TAY()
+		{
+			T_General(R.A, R.Y);
+			++R.PC;
+			return 2;
+		}
 
-	int INC_Absolute()
-	{
-		uint16_t address = ResolveAbsolute();
-		uint8_t num = read(address);
-		INC_General(num);
-		write(address, num);
-		++R.PC;
-		return 6;
-	}
+		template <Mode MODE>
+		int TSX()
+		{
+			T_General(R.SP, R.X);
+			++R.PC;
+			return 2;
+		}
 
-	int INC_AbsoluteX()
-	{
-		bool t;
-		uint16_t address = ResolveAbsoluteX(t);
-		uint8_t num = read(address);
-		INC_General(num);
-		write(address, num);
-		++R.PC;
-		return 7;
-	}
+		template <Mode MODE>
+		int TXA()
+		{
+			T_General(R.X, R.A);
+			++R.PC;
+			return 2;
+		}
 
-	int INX()
-	{
-		INC_General(R.X);
-		++R.PC;
-		return 2;
-	}
+		template <Mode MODE>
+		int TXS()
+		{
+			R.SP = R.X;
+			++R.PC;
+			return 2;
+		}
 
-	int INY()
-	{
-		INC_General(R.Y);
-		++R.PC;
-		return 2;
-	}
+		template <Mode MODE>
+		int TYA()
+		{
+			T_General(R.Y, R.A);
+			++R.PC;
+			return 2;
+		}
 
-	int JMP_Absolute()
-	{
-		uint16_t jmpAddress = ((uint16_t)read(++R.PC)) | (((uint16_t)read(++R.PC)) << 8);
-		R.PC = jmpAddress;
-		return 3;
-	}
+		// The switch core. Every handler is inlined into its case, so there is no indirect call or
+		// function prologue per instruction, only the jump through the switch table.
+		__attribute__((always_inline, flatten)) int step()
+		{
+			return execute(read(R.PC));
+		}
 
-	int JMP_Indirect()
-	{
-		uint16_t indirectAddress = ((uint16_t)read(++R.PC)) | (((uint16_t)read(++R.PC)) << 8);
-		uint16_t jmpAddress = ((uint16_t)read(indirectAddress)) | (((uint16_t)read(indirectAddress + 1)) << 8);
-		R.PC = jmpAddress;
-		return 5;
-	}
+		// The same with the opcode already fetched from the PC, for callers that want to know it
+		__attribute__((always_inline, flatten)) int execute(uint8_t opcode)
+		{
+			switch (opcode)
+			{
+#define X(op, name, mode) case op: return name<MODE_##mode>();
+			OPCODE_LIST(X)
+#undef X
+			default: return InvalidInstruction();
+			}
+		}
 
-	int JSR()
-	{
-		uint16_t jmpAddress = ((uint16_t)read(++R.PC)) | (((uint16_t)read(++R.PC)) << 8);
-		PushStackGeneral((uint8_t)((R.PC >> 8) & 0x00FF)); // Push High byte onto stack
-		PushStackGeneral((uint8_t)(R.PC & 0x00FF)); // Push low byte onto stack
-		R.PC = jmpAddress; // Jump to new address
-		return 6;
-	}
+		// Run one op of a decoded block
+		__attribute__((always_inline, flatten)) int step(const DecodedOp &op)
+		{
+			operand = op.operand;
+			return op.handler(*this);
+		}
+	};
 
-	int LDA_Immediate()
-	{
-		LD_General(R.A, read(++R.PC));
-		++R.PC;
-		return 2;
-	}
+	typedef ContextT<false> Context;
 
-	int LDA_ZP()
+	// Calls one handler of a decoded context, so the block cache can store a plain function pointer
+	template <int (DecodedContext::*HANDLER)()>
+	int callDecoded(DecodedContext &context)
 	{
-		LD_General(R.A, read(ResolveZP()));
-		++R.PC;
-		return 3;
+		return (context.*HANDLER)();
 	}
 
-	int LDA_ZPX()
+	// Handler pointers and lengths for every opcode. Built by the compiler and shared by all Cpu instances.
+	struct InstructionTable
 	{
-		LD_General(R.A, read(ResolveZPX()));
-		++R.PC;
-		return 4;
-	}
+		int (Context::*handler[256])() = {};
+		int (*decoded[256])(DecodedContext &context) = {};
+		uint8_t length[256] = {};
+		const char *name[256] = {};
+		Mode mode[256] = {};
 
-	int LDA_Absolute()
-	{
-		LD_General(R.A, read(ResolveAbsolute()));
-		++R.PC;
-		return 4;
-	}
+		constexpr InstructionTable()
+		{
+			// Initialize function pointer array to NOP for all instructions.
+			for (int i = 0; i < 256; i++)
+			{
+				handler[i] = &Context::InvalidInstruction;
+				decoded[i] = &callDecoded<&DecodedContext::InvalidInstruction>;
+				length[i] = 1;
+				mode[i] = MODE_IMPLIED;
+			}
 
-	int LDA_AbsoluteX()
-	{
-		bool pageCrossed;
-		LD_General(R.A, read(ResolveAbsoluteX(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 5 : 4;
-	}
+#define X(op, operation, addressing) \
+			handler[op] = &Context::operation<MODE_##addressing>; \
+			decoded[op] = &callDecoded<&DecodedContext::operation<MODE_##addressing>>; \
+			length[op] = modeLength(MODE_##addressing); \
+			name[op] = #operation; \
+			mode[op] = MODE_##addressing;
+			OPCODE_LIST(X)
+#undef X
+		}
+	};
 
-	int LDA_AbsoluteY()
-	{
-		bool pageCrossed;
-		LD_General(R.A, read(ResolveAbsoluteY(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 5 : 4;
-	}
+	constexpr InstructionTable instruction;
 
-	int LDA_IndirectX()
+	OpcodeInfo getOpcodeInfo(uint8_t opcode)
 	{
-		LD_General(R.A, read(ResolveIndirectX()));
-		++R.PC;
-		return 6;
+		return {instruction.name[opcode], instruction.mode[opcode], instruction.length[opcode]};
 	}
 
-	int LDA_IndirectY()
+	// Set up a context for the given registers, binding the zero page and stack if they are plain RAM
+	template <bool DECODED>
+	ContextT<DECODED> makeContext(const RegisterSet &R, arx65::bus::Bus *bus, BlockCache *cache)
 	{
-		bool pageCrossed;
-		LD_General(R.A, read(ResolveIndirectY(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 6 : 5;
+		// The lazy flags are unpacked from R.Flags the same way setFlags does it
+		return {R, bus, bus->getDirectRange(0x0000, 0x01FF), cache, 0, R.Flags, (uint8_t)(~R.Flags & FLAG_ZERO),
+			(uint8_t)(R.Flags & FLAG_CARRY), (uint8_t)(R.Flags & FLAG_OVERFLOW)};
 	}
 
-	int LDX_Immediate()
+	// True for the instructions that end a block: anything that can send the PC somewhere other
+	// than the next instruction.
+	bool endsBlock(uint8_t opcode)
 	{
-		LD_General(R.X, read(++R.PC));
-		++R.PC;
-		return 2;
+		switch (opcode)
+		{
+		case 0x00: case 0x20: case 0x40: case 0x4C: case 0x60: case 0x6C:
+		case 0x10: case 0x30: case 0x50: case 0x70: case 0x90: case 0xB0: case 0xD0: case 0xF0:
+			return true;
+		}
+		return false;
 	}
 
-	int LDX_ZP()
-	{
-		LD_General(R.X, read(ResolveZP()));
-		++R.PC;
-		return 3;
-	}
+	// Longest block decoded in one go, so a long run of straight code still returns to the run loop
+	// and an interrupt is not held off for long, see Cpu::setCore
+	const size_t MAX_BLOCK_OPS = 64;
 
-	int LDX_ZPY()
-	{
-		LD_General(R.X, read(ResolveZPY()));
-		++R.PC;
-		return 4;
-	}
+	// Times a block is entered before the JIT core compiles it
+	const unsigned int JIT_THRESHOLD = 16;
 
-	int LDX_Absolute()
+	// Decode the block starting at address, or return nullptr if the code there is not plain memory
+	Block *decodeBlock(arx65::bus::Bus *bus, uint16_t address)
 	{
-		LD_General(R.X, read(ResolveAbsolute()));
-		++R.PC;
-		return 4;
-	}
+		Block *block = new Block;
+		block->start = address;
 
-	int LDX_AbsoluteY()
-	{
-		bool pageCrossed;
-		LD_General(R.X, read(ResolveAbsoluteY(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 5 : 4;
-	}
+		uint32_t pc = address;
+		while (block->ops.size() < MAX_BLOCK_OPS)
+		{
+			uint8_t opcode = bus->isDirectRead(pc) ? bus->read(pc) : 0;
+			uint8_t length = instruction.length[opcode];
 
-	int LDY_Immediate()
-	{
-		LD_General(R.Y, read(++R.PC));
-		++R.PC;
-		return 2;
-	}
+			// Stop at anything we could not safely read ahead of time, and at the end of memory
+			if (!bus->isDirectRead(pc) || pc + length > 0x10000 || !bus->isDirectRead(pc + length - 1)) break;
 
-	int LDY_ZP()
-	{
-		LD_General(R.Y, read(ResolveZP()));
-		++R.PC;
-		return 3;
-	}
+			DecodedOp op;
+			op.handler = instruction.decoded[opcode];
+			op.opcode = opcode;
+			op.length = length;
+			op.operand = length == 3 ? bus->read16(pc + 1) : length == 2 ? bus->read(pc + 1) : 0;
+			block->ops.push_back(op);
 
-	int LDY_ZPX()
-	{
-		LD_General(R.Y, read(ResolveZPX()));
-		++R.PC;
-		return 4;
-	}
+			pc += length;
+			if (endsBlock(opcode)) break;
+		}
 
-	int LDY_Absolute()
-	{
-		LD_General(R.Y, read(ResolveAbsolute()));
-		++R.PC;
-		return 4;
-	}
+		if (block->ops.empty())
+		{
+			delete block;
+			return nullptr;
+		}
 
-	int LDY_AbsoluteX()
-	{
-		bool pageCrossed;
-		LD_General(R.Y, read(ResolveAbsoluteX(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 5 : 4;
+		block->end = pc - 1;
+		return block;
 	}
 
-	int LSR_Accumulator()
+	int jitInterpret(JitState *state, const DecodedOp *op)
 	{
-		LSR_General(R.A);
-		++R.PC;
-		return 2;
+		unsigned int generation = state->cache->generation;
+		DecodedContext c = makeContext<true>(state->R, state->bus, state->cache);
+		int cycles = c.step(*op);
+		state->R = c.registers();
+		if (state->cache->generation != generation) state->leave = 1;
+		return cycles;
 	}
 
-	int LSR_ZP()
+	Cpu::Cpu(arx65::bus::Bus *bus)
 	{
-		uint8_t address = ResolveZP();
-		uint8_t num = read(address);
-		LSR_General(num);
-		write(address, num);
-		++R.PC;
-		return 5;
+		this->bus = bus;
+		R = {};
+		activeCore = CORE_TABLE;
+		blocks = nullptr;
+		jit = nullptr;
+		jitDifferential = false;
+		jitMismatches = 0;
+		profile = nullptr;
+		irqSources = 0;
+		nmiSources = 0;
+		nmiPending = false;
+		interruptSourcesUsed = 0;
+		cycleCount = 0;
+		instructionCount = 0;
 	}
 
-	int LSR_ZPX()
+	Cpu::~Cpu()
 	{
-		uint8_t address = ResolveZPX();
-		uint8_t num = read(address);
-		LSR_General(num);
-		write(address, num);
-		++R.PC;
-		return 6;
+		delete jit;
+		delete blocks;
 	}
 
-	int LSR_Absolute()
+	RegisterSet *Cpu::getRegisters()
 	{
-		uint8_t address = ResolveAbsolute();
-		uint8_t num = read(address);
-		LSR_General(num);
-		write(address, num);
-		++R.PC;
-		return 6;
+		return &R;
 	}
 
-	int LSR_AbsoluteX()
+	RegisterSet Cpu::getRegistersCopy()
 	{
-		bool temp;
-		uint8_t address = ResolveAbsoluteX(temp); // TODO: This doesn't actually need this variable, maybe provide an implementation that ignores new pages.
-		uint8_t num = read(address);
-		LSR_General(num);
-		write(address, num);
-		++R.PC;
-		return 7;
+		return R;
 	}
 
-	int NOP()
+	template <bool DECODED>
+	int Cpu::takeInterrupt(ContextT<DECODED> &context)
 	{
-		++R.PC;
-		return 2;
+		// NMI first, it wins over an IRQ arriving at the same time
+		if (nmiPending.load(std::memory_order_relaxed) && nmiPending.exchange(false))
+		{
+			context.doNMI();
+			return 7;
+		}
+		if (irqSources.load(std::memory_order_relaxed) && !(context.R.Flags & FLAG_INTERRUPT))
+		{
+			context.doIRQ();
+			return 7;
+		}
+		return 0;
 	}
 
-	int ORA_Immediate()
+	int Cpu::doNextInstruction()
 	{
-		ORA_General(read(++R.PC));
-		++R.PC;
-		return 2;
-	}
+		scheduler.runDue(cycleCount);
+		scheduler.preempt = false;
 
-	int ORA_ZP()
-	{
-		ORA_General(read(ResolveZP()));
-		++R.PC;
-		return 3;
-	}
+		Context c = makeContext<false>(R, bus, blocks);
+		int cycles = 0;
+		if (needsAttention()) cycles = takeInterrupt(c);
 
-	int ORA_ZPX()
-	{
-		ORA_General(read(ResolveZPX()));
-		++R.PC;
-		return 4;
+		// The opcode is fetched once here, the handlers only read their operands
+		const uint16_t pc = c.R.PC;
+		const uint8_t opcode = c.read(pc);
+		int taken = activeCore == CORE_TABLE ? (c.*instruction.handler[opcode])() : c.execute(opcode);
+		cycles += taken;
+#ifndef ARX65_NO_PROFILE
+		if (profile) profile->record(pc, opcode, taken);
+#endif
+		R = c.registers();
+		cycleCount += cycles;
+		instructionCount++;
+		return cycles;
 	}
 
-	int ORA_Absolute()
+	// Shared by runCycles and runUntil. Splits the budget into slices that end at the next event, so
+	// the loops below never look at the scheduler unless a device schedules something earlier.
+	long Cpu::runScheduled(long budget, const std::function<bool(const RegisterSet &)> *stop)
 	{
-		ORA_General(read(ResolveAbsolute()));
-		++R.PC;
-		return 4;
-	}
+		long cycles = 0;
+		bool stopped = false;
 
-	int ORA_AbsoluteX()
-	{
-		bool pageCrossed;
-		ORA_General(read(ResolveAbsoluteX(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 5 : 4;
-	}
+		while (cycles < budget && !stopped)
+		{
+			scheduler.runDue(cycleCount);
+			scheduler.preempt = false;
+
+			// Events still in the heap are all in the future now
+			long slice = budget - cycles;
+			uint64_t untilEvent = scheduler.nextDeadline() - cycleCount;
+			if (untilEvent < (uint64_t)slice) slice = untilEvent;
+
+#ifndef ARX65_NO_PROFILE
+			if (profile) cycles += runLoop<true>(slice, stop, stopped);
+			else
+#endif
+			cycles += runLoop<false>(slice, stop, stopped);
+		}
 
-	int ORA_AbsoluteY()
-	{
-		bool pageCrossed;
-		ORA_General(read(ResolveAbsoluteY(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 5 : 4;
+		scheduler.runDue(cycleCount);
+		return cycles;
 	}
 
-	int ORA_IndirectX()
+	// The state is copied into a local context for the slice and only written back when it ends,
+	// so the switch core can keep the registers in host registers. When PROFILE is false the counting
+	// is compiled out and the loops are the same as without profiling support.
+	template <bool PROFILE>
+	long Cpu::runLoop(long budget, const std::function<bool(const RegisterSet &)> *stop, bool &stopped)
 	{
-		ORA_General(read(ResolveIndirectX()));
-		++R.PC;
-		return 6;
-	}
+		long cycles = 0, instructions = 0;
+		const uint64_t start = cycleCount;
 
-	int ORA_IndirectY()
-	{
-		bool pageCrossed;
-		ORA_General(read(ResolveIndirectY(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 6 : 5;
-	}
+		if (activeCore == CORE_BLOCK || activeCore == CORE_JIT) return runBlocks<PROFILE>(budget, stop, stopped);
 
-	int PHA()
-	{
-		PushStackGeneral(R.A);
-		++R.PC;
-		return 3;
-	}
+		Context local = makeContext<false>(R, bus, nullptr);
 
-	int PHP()
-	{
-		PushStackGeneral(R.Flags | 0x20 | FLAG_BRK);
-		++R.PC;
-		return 3;
-	}
+		if (activeCore == CORE_TABLE)
+		{
+			while (cycles < budget)
+			{
+				if (needsAttention())
+				{
+					if (scheduler.preempt) break;
+					cycles += takeInterrupt(local);
+				}
+				const uint16_t pc = local.R.PC;
+				const uint8_t opcode = local.read(pc);
+				int taken = (local.*instruction.handler[opcode])();
+				cycles += taken;
+				if (PROFILE) profile->record(pc, opcode, taken);
+				cycleCount = start + cycles;
+				instructions++;
+				if (stop && (stopped = (*stop)(local.registers()))) break;
+			}
+		}
+		else
+		{
+			while (cycles < budget)
+			{
+				if (needsAttention())
+				{
+					if (scheduler.preempt) break;
+					cycles += takeInterrupt(local);
+				}
+				if (PROFILE)
+				{
+					const uint16_t pc = local.R.PC;
+					const uint8_t opcode = local.read(pc);
+					int taken = local.execute(opcode);
+					cycles += taken;
+					profile->record(pc, opcode, taken);
+				}
+				else
+					cycles += local.step();
+				cycleCount = start + cycles;
+				instructions++;
+
+				// The predicate gets a copy so the local registers never have their address taken
+				if (stop && (stopped = (*stop)(local.registers()))) break;
+			}
+		}
 
-	int PLA()
-	{
-		R.A = PullStackGeneral();
-		R.Flags &= ~(FLAG_ZERO | FLAG_NEGATIVE);
-		R.Flags |= (R.A == 0 ? FLAG_ZERO : 0) | (R.A & 0x80 ? FLAG_NEGATIVE : 0x00);
-		++R.PC;
-		return 4;
+		R = local.registers();
+		instructionCount += instructions;
+		return cycles;
 	}
 
-	int PLP()
+	// The block core. Looks up or decodes the block at the PC and runs its ops without fetching or
+	// decoding anything. A write that invalidates cached code ends the block right after that op.
+	// With the JIT, blocks entered often enough are compiled and run natively from then on, and
+	// the stop predicate is only checked between compiled blocks. Profiling runs compiled blocks
+	// through the decoded ops instead, which gives the same result one instruction at a time.
+	template <bool PROFILE>
+	long Cpu::runBlocks(long budget, const std::function<bool(const RegisterSet &)> *stop, bool &stopped)
 	{
-		R.Flags = PullStackGeneral() | 0x20;
-		++R.PC;
-		return 4;
-	}
+		long cycles = 0, instructions = 0;
+		const uint64_t start = cycleCount;
+		DecodedContext local = makeContext<true>(R, bus, blocks);
 
-	int ROL_Accumulator()
-	{
-		ROL_General(R.A);
-		++R.PC;
-		return 2;
-	}
+		// Compiled code points straight into the page map, so it can not outlive it
+		if (jit && jit->isStale())
+		{
+			blocks->clear();
+			jit->reset();
+		}
 
-	int ROL_ZP()
-	{
-		uint8_t address = ResolveZP();
-		uint8_t num = read(address);
-		ROL_General(num);
-		write(address, num);
-		++R.PC;
-		return 5;
-	}
+		while (cycles < budget && !stopped)
+		{
+			// Interrupts and newly scheduled events are only noticed between blocks here
+			if (needsAttention())
+			{
+				if (scheduler.preempt) break;
+				cycles += takeInterrupt(local);
+			}
 
-	int ROL_ZPX()
-	{
-		uint8_t address = ResolveZPX();
-		uint8_t num = read(address);
-		ROL_General(num);
-		write(address, num);
-		++R.PC;
-		return 6;
-	}
+			Block *block = blocks->find(local.R.PC);
+			if (block == nullptr)
+			{
+				block = decodeBlock(bus, local.R.PC);
+				if (block) blocks->insert(block);
+			}
 
-	int ROL_Absolute()
-	{
-		uint8_t address = ResolveAbsolute();
-		uint8_t num = read(address);
-		ROL_General(num);
-		write(address, num);
-		++R.PC;
-		return 6;
-	}
+			if (block == nullptr)
+			{
+				// Code outside plain memory is interpreted one instruction at a time
+				Context c = makeContext<false>(local.registers(), bus, blocks);
+				const uint16_t pc = c.R.PC;
+				const uint8_t opcode = c.read(pc);
+				int taken = c.execute(opcode);
+				cycles += taken;
+				if (PROFILE) profile->record(pc, opcode, taken);
+				cycleCount = start + cycles;
+				instructions++;
+				local.setRegisters(c.registers());
+				stopped = stop && (*stop)(local.registers());
+				continue;
+			}
 
-	int ROL_AbsoluteX()
-	{
-		bool temp;
-		uint8_t address = ResolveAbsoluteX(temp); // TODO: This doesn't actually need this variable, maybe provide an implementation that ignores new pages.
-		uint8_t num = read(address);
-		ROL_General(num);
-		write(address, num);
-		++R.PC;
-		return 7;
-	}
+			if (jit && block->native == nullptr && ++block->executions == JIT_THRESHOLD && !jit->compile(block))
+			{
+				// Out of code space, start over. The block itself stays valid until collect().
+				blocks->clear();
+				jit->reset();
+			}
 
-	int ROR_Accumulator()
-	{
-		ROR_General(R.A);
-		++R.PC;
-		return 2;
-	}
+			if (!PROFILE && block->native)
+			{
+				RegisterSet registers = local.registers();
+				cycles += runCompiled(block, registers);
+				cycleCount = start + cycles;
+				instructions += jit->state.completed;
+				local.setRegisters(registers);
+				stopped = stop && (*stop)(local.registers());
+				continue;
+			}
 
-	int ROR_ZP()
-	{
-		uint8_t address = ResolveZP();
-		uint8_t num = read(address);
-		ROR_General(num);
-		write(address, num);
-		++R.PC;
-		return 5;
-	}
+			unsigned int generation = blocks->generation;
+			for (const DecodedOp &op : block->ops)
+			{
+				const uint16_t pc = local.R.PC;
+				int taken = local.step(op);
+				cycles += taken;
+				if (PROFILE) profile->record(pc, op.opcode, taken);
+				cycleCount = start + cycles;
+				instructions++;
+
+				if (stop && (*stop)(local.registers()))
+				{
+					stopped = true;
+					break;
+				}
+				if (blocks->generation != generation) break;
+			}
+		}
 
-	int ROR_ZPX()
-	{
-		uint8_t address = ResolveZPX();
-		uint8_t num = read(address);
-		ROR_General(num);
-		write(address, num);
-		++R.PC;
-		return 6;
+		blocks->collect();
+		R = local.registers();
+		instructionCount += instructions;
+		return cycles;
 	}
 
-	int ROR_Absolute()
+	long Cpu::runCompiled(Block *block, RegisterSet &registers)
 	{
-		uint8_t address = ResolveAbsolute();
-		uint8_t num = read(address);
-		ROR_General(num);
-		write(address, num);
-		++R.PC;
-		return 6;
-	}
+		JitState &state = jit->state;
+		state.R = registers;
+		state.cycles = 0;
+		state.leave = 0;
+		jit->getLog().clear();
 
-	int ROR_AbsoluteX()
-	{
-		bool temp;
-		uint8_t address = ResolveAbsoluteX(temp); // TODO: This doesn't actually need this variable, maybe provide an implementation that ignores new pages.
-		uint8_t num = read(address);
-		ROR_General(num);
-		write(address, num);
-		++R.PC;
-		return 7;
-	}
+		((JitCode)block->native)(&state);
 
-	int RTI()
-	{
-		R.Flags = PullStackGeneral();
-		R.PC = ((uint16_t)PullStackGeneral()) | (((uint16_t)PullStackGeneral()) << 8);
-		return 6;
+		if (jitDifferential) checkCompiled(block, registers);
+		registers = state.R;
+		return state.cycles;
 	}
 
-	int RTS()
+	// Undo what a compiled block did to memory, run the same ops through the interpreter against the
+	// old memory and the values devices gave the compiled code, compare, then redo the block's writes.
+	void Cpu::checkCompiled(const Block *block, const RegisterSet &before)
 	{
-		R.PC = ( ((uint16_t)PullStackGeneral()) | (((uint16_t)PullStackGeneral()) << 8) ) + 1;
-		return 6;
-	}
+		const JitState &state = jit->state;
+		const std::vector<JitAccess> &log = jit->getLog();
+		uint8_t *const *pages = bus->getDirectWritePages();
 
-	int SBC_Immediate()
-	{
-		SBC_General(read(++R.PC));
-		++R.PC;
-		return 2;
-	}
+		for (auto it = log.rbegin(); it != log.rend(); ++it)
+		{
+			if (it->write && it->direct) pages[it->address >> 8][it->address & 0xFF] = it->old;
+		}
 
-	int SBC_ZP()
-	{
-		SBC_General(read(ResolveZP()));
-		++R.PC;
-		return 3;
-	}
+		JitReplay &replay = jit->getReplay();
+		replay.reset();
 
-	int SBC_ZPX()
-	{
-		SBC_General(read(ResolveZPX()));
-		++R.PC;
-		return 4;
-	}
+		DecodedContext reference = makeContext<true>(before, jit->getReplayBus(), nullptr);
+		long cycles = 0;
+		for (uint32_t i = 0; i < state.completed; i++) cycles += reference.step(block->ops[i]);
 
-	int SBC_Absolute()
-	{
-		SBC_General(read(ResolveAbsolute()));
-		++R.PC;
-		return 4;
-	}
+		for (const JitAccess &access : log)
+		{
+			if (access.write && access.direct) pages[access.address >> 8][access.address & 0xFF] = access.value;
+		}
 
-	int SBC_AbsoluteX()
-	{
-		bool pageCrossed;
-		SBC_General(read(ResolveAbsoluteX(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 5 : 4;
-	}
+		std::vector<JitAccess> written;
+		for (const JitAccess &access : log)
+		{
+			if (access.write) written.push_back(access);
+		}
 
-	int SBC_AbsoluteY()
-	{
-		bool pageCrossed;
-		SBC_General(read(ResolveAbsoluteY(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 5 : 4;
-	}
+		const RegisterSet r = reference.registers(), &j = state.R;
+		// Field by field, since the padding in RegisterSet is not guaranteed to match
+		bool same = !replay.diverged && cycles == state.cycles && written.size() == replay.writes.size()
+			&& r.A == j.A && r.X == j.X && r.Y == j.Y && r.Flags == j.Flags && r.SP == j.SP && r.PC == j.PC;
+		for (size_t i = 0; same && i < written.size(); i++)
+		{
+			same = written[i].address == replay.writes[i].address && written[i].value == replay.writes[i].value;
+		}
+		if (same) return;
 
-	int SBC_IndirectX()
-	{
-		SBC_General(read(ResolveIndirectX()));
-		++R.PC;
-		return 6;
+		++jitMismatches;
+		std::cerr << "JIT mismatch in block $" << HEX(4, block->start) << " after " << state.completed << " ops:" << std::endl
+			<< "  interpreter A=" << HEX(2, r.A) << " X=" << HEX(2, r.X) << " Y=" << HEX(2, r.Y) << " P=" << HEX(2, r.Flags)
+			<< " SP=" << HEX(2, r.SP) << " PC=" << HEX(4, r.PC) << " cycles=" << cycles << " writes=" << replay.writes.size() << std::endl
+			<< "  compiled    A=" << HEX(2, j.A) << " X=" << HEX(2, j.X) << " Y=" << HEX(2, j.Y) << " P=" << HEX(2, j.Flags)
+			<< " SP=" << HEX(2, j.SP) << " PC=" << HEX(4, j.PC) << " cycles=" << state.cycles << " writes=" << written.size()
+			<< (replay.diverged ? " (device reads diverged)" : "") << std::endl;
 	}
 
-	int SBC_IndirectY()
+	long Cpu::runCycles(long budget)
 	{
-		bool pageCrossed;
-		SBC_General(read(ResolveIndirectY(pageCrossed)));
-		++R.PC;
-		return pageCrossed ? 6 : 5;
+		return runScheduled(budget, nullptr);
 	}
 
-	int SEC()
+	long Cpu::runUntil(std::function<bool(const RegisterSet &)> stop, long budget)
 	{
-		R.Flags |= FLAG_CARRY;
-		++R.PC;
-		return 2;
+		return runScheduled(budget, &stop);
 	}
 
-	int SED()
+	uint64_t Cpu::getCycles()
 	{
-		R.Flags |= FLAG_DECIMAL;
-		++R.PC;
-		return 2;
+		return cycleCount;
 	}
 
-	int SEI()
+	uint64_t Cpu::getInstructions()
 	{
-		R.Flags |= FLAG_INTERRUPT;
-		++R.PC;
-		return 2;
+		return instructionCount;
 	}
 
-	int STA_ZP()
+	Scheduler *Cpu::getScheduler()
 	{
-		write(ResolveZP(), R.A);
-		++R.PC;
-		return 3;
+		return &scheduler;
 	}
 
-	int STA_ZPX()
+	void Cpu::doNMI()
 	{
-		write(ResolveZPX(), R.A);
-		++R.PC;
-		return 4;
+		Context c = makeContext<false>(R, bus, blocks);
+		c.doNMI();
+		R = c.registers();
 	}
 
-	int STA_Absolute()
+	void Cpu::doRES()
 	{
-		write(ResolveAbsolute(), R.A);
-		++R.PC;
-		return 4;
+		Context c = makeContext<false>(R, bus, blocks);
+		c.doRES();
+		R = c.registers();
 	}
 
-	int STA_AbsoluteX()
+	void Cpu::doIRQ()
 	{
-		bool pageCrossed;
-		write(ResolveAbsoluteX(pageCrossed), R.A);
-		++R.PC;
-		return 5;
+		Context c = makeContext<false>(R, bus, blocks);
+		c.doIRQ();
+		R = c.registers();
 	}
 
-	int STA_AbsoluteY()
+	uint32_t Cpu::allocateInterruptSource()
 	{
-		bool pageCrossed;
-		write(ResolveAbsoluteY(pageCrossed), R.A);
-		++R.PC;
-		return 5;
+		if (interruptSourcesUsed >= 32)
+		{
+			std::cerr << "Out of interrupt sources, the device will not be able to interrupt.\r\n";
+			return 0;
+		}
+		return 1u << interruptSourcesUsed++;
 	}
 
-	int STA_IndirectX()
+	void Cpu::assertIRQ(uint32_t source)
 	{
-		write(ResolveIndirectX(), R.A);
-		++R.PC;
-		return 6;
+		irqSources.fetch_or(source);
 	}
 
-	int STA_IndirectY()
+	void Cpu::deassertIRQ(uint32_t source)
 	{
-		bool pageCrossed;
-		write(ResolveIndirectY(pageCrossed), R.A);
-		++R.PC;
-		return 6;
+		irqSources.fetch_and(~source);
 	}
 
-	int STX_ZP()
+	void Cpu::assertNMI(uint32_t source)
 	{
-		write(ResolveZP(), R.X);
-		++R.PC;
-		return 3;
+		if (source && nmiSources.fetch_or(source) == 0) nmiPending = true;
 	}
 
-	int STX_ZPY()
+	void Cpu::deassertNMI(uint32_t source)
 	{
-		write(ResolveZPY(), R.X);
-		++R.PC;
-		return 4;
+		nmiSources.fetch_and(~source);
 	}
 
-	int STX_Absolute()
+	void Cpu::setCore(Core core)
 	{
-		write(ResolveAbsolute(), R.X);
-		++R.PC;
-		return 4;
-	}
+		activeCore = core;
 
-	int STY_ZP()
-	{
-		write(ResolveZP(), R.Y);
-		++R.PC;
-		return 3;
-	}
+		// Memory may have changed while the cache was not watching writes, so start it empty
+		delete jit;
+		delete blocks;
+		blocks = core == CORE_BLOCK || core == CORE_JIT ? new BlockCache() : nullptr;
 
-	int STY_ZPX()
-	{
-		write(ResolveZPX(), R.Y);
-		++R.PC;
-		return 4;
+		// Without JIT support for the host, the JIT core is just the block core
+		jit = core == CORE_JIT && Jit::isSupported() ? new Jit(bus, blocks) : nullptr;
+		if (jit) jit->setChecking(jitDifferential);
 	}
 
-	int STY_Absolute()
+	Core Cpu::getCore()
 	{
-		write(ResolveAbsolute(), R.Y);
-		++R.PC;
-		return 4;
+		return activeCore;
 	}
 
-	int TAX()
+	void Cpu::setJitDifferential(bool enable)
 	{
-		T_General(R.A, R.X);
-		++R.PC;
-		return 2;
-	}
+		jitDifferential = enable;
 
-	int TAY()
-	{
-		T_General(R.A, R.Y);
-		++R.PC;
-		return 2;
+		// Code compiled before has no logging, so compile everything again
+		if (jit)
+		{
+			blocks->clear();
+			jit->reset();
+			jit->setChecking(enable);
+		}
 	}
 
-	int TSX()
+	void Cpu::setProfile(Profile *profile)
 	{
-		T_General(R.SP, R.X);
-		++R.PC;
-		return 2;
+		this->profile = profile;
 	}
 
-	int TXA()
+	Profile *Cpu::getProfile()
 	{
-		T_General(R.X, R.A);
-		++R.PC;
-		return 2;
+		return profile;
 	}
 
-	int TXS()
+	unsigned long Cpu::getJitMismatches()
 	{
-		R.SP = R.X;
-		++R.PC;
-		return 2;
+		return jitMismatches;
 	}
 
-	int TYA()
+	void Cpu::invalidateCode()
 	{
-		T_General(R.Y, R.A);
-		++R.PC;
-		return 2;
+		if (blocks) blocks->clear();
 	}
 
-	void init()
+	void Cpu::init()
 	{
-		// Initialize function pointer array to NOP for all instructions.
-		for (int i = 0; i < 256; i++) instruction[i] = &InvalidInstruction;
-
-		instruction[0x69] = &ADC_Immediate;
-		instruction[0x65] = &ADC_ZP;
-		instruction[0x75] = &ADC_ZPX;
-		instruction[0x6D] = &ADC_Absolute;
-		instruction[0x7D] = &ADC_AbsoluteX;
-		instruction[0x79] = &ADC_AbsoluteY;
-		instruction[0x61] = &ADC_IndirectX;
-		instruction[0x71] = &ADC_IndirectY;
-
-		instruction[0x29] = &AND_Immediate;
-		instruction[0x25] = &AND_ZP;
-		instruction[0x35] = &AND_ZPX;
-		instruction[0x2D] = &AND_Absolute;
-		instruction[0x3D] = &AND_AbsoluteX;
-		instruction[0x39] = &AND_AbsoluteY;
-		instruction[0x21] = &AND_IndirectX;
-		instruction[0x31] = &AND_IndirectY;
-
-		instruction[0x0A] = &ASL_Accumulator;
-		instruction[0x06] = &ASL_ZP;
-		instruction[0x16] = &ASL_ZPX;
-		instruction[0x0E] = &ASL_Absolute;
-		instruction[0x1E] = &ASL_AbsoluteX;
-
-		instruction[0x90] = &BCC;
-		instruction[0xB0] = &BCS;
-		instruction[0xF0] = &BEQ;
-		instruction[0x30] = &BMI;
-		instruction[0xD0] = &BNE;
-		instruction[0x10] = &BPL;
-		instruction[0x50] = &BVC;
-		instruction[0x70] = &BVS;
-
-		instruction[0x24] = &BIT_ZP;
-		instruction[0x2C] = &BIT_Absolute;
-
-		instruction[0x00] = &BRK;
-
-		instruction[0x18] = &CLC;
-		instruction[0xD8] = &CLD;
-		instruction[0x58] = &CLI;
-		instruction[0xB8] = &CLV;
-
-		instruction[0xC9] = &CMP_Immediate;
-		instruction[0xC5] = &CMP_ZP;
-		instruction[0xD5] = &CMP_ZPX;
-		instruction[0xCD] = &CMP_Absolute;
-		instruction[0xDD] = &CMP_AbsoluteX;
-		instruction[0xD9] = &CMP_AbsoluteY;
-		instruction[0xC1] = &CMP_IndirectX;
-		instruction[0xD1] = &CMP_IndirectY;
-
-		instruction[0xE0] = &CPX_Immediate;
-		instruction[0xE4] = &CPX_ZP;
-		instruction[0xEC] = &CPX_Absolute;
-
-		instruction[0xC0] = &CPY_Immediate;
-		instruction[0xC4] = &CPY_ZP;
-		instruction[0xCC] = &CPY_Absolute;
-
-		instruction[0xC6] = &DEC_ZP;
-		instruction[0xD6] = &DEC_ZPX;
-		instruction[0xCE] = &DEC_Absolute;
-		instruction[0xDE] = &DEC_AbsoluteX;
-
-		instruction[0xCA] = &DEX;
-		instruction[0x88] = &DEY;
-
-		instruction[0x49] = &EOR_Immediate;
-		instruction[0x45] = &EOR_ZP;
-		instruction[0x55] = &EOR_ZPX;
-		instruction[0x4D] = &EOR_Absolute;
-		instruction[0x5D] = &EOR_AbsoluteX;
-		instruction[0x59] = &EOR_AbsoluteY;
-		instruction[0x41] = &EOR_IndirectX;
-		instruction[0x51] = &EOR_IndirectY;
-
-		instruction[0xE6] = &INC_ZP;
-		instruction[0xF6] = &INC_ZPX;
-		instruction[0xEE] = &INC_Absolute;
-		instruction[0xFE] = &INC_AbsoluteX;
-
-		instruction[0xE8] = &INX;
-		instruction[0xC8] = &INY;
-
-		instruction[0x4C] = &JMP_Absolute;
-		instruction[0x6C] = &JMP_Indirect;
-
-		instruction[0x20] = &JSR;
-
-		instruction[0xA9] = &LDA_Immediate;
-		instruction[0xA5] = &LDA_ZP;
-		instruction[0xB5] = &LDA_ZPX;
-		instruction[0xAD] = &LDA_Absolute;
-		instruction[0xBD] = &LDA_AbsoluteX;
-		instruction[0xB9] = &LDA_AbsoluteY;
-		instruction[0xA1] = &LDA_IndirectX;
-		instruction[0xB1] = &LDA_IndirectY;
-
-		instruction[0xA2] = &LDX_Immediate;
-		instruction[0xA6] = &LDX_ZP;
-		instruction[0xB6] = &LDX_ZPY;
-		instruction[0xAE] = &LDX_Absolute;
-		instruction[0xBE] = &LDX_AbsoluteY;
-
-		instruction[0xA0] = &LDY_Immediate;
-		instruction[0xA4] = &LDY_ZP;
-		instruction[0xB4] = &LDY_ZPX;
-		instruction[0xAC] = &LDY_Absolute;
-		instruction[0xBC] = &LDY_AbsoluteX;
-
-		instruction[0x4A] = &LSR_Accumulator;
-		instruction[0x46] = &LSR_ZP;
-		instruction[0x56] = &LSR_ZPX;
-		instruction[0x4E] = &LSR_Absolute;
-		instruction[0x5E] = &LSR_AbsoluteX;
-
-		instruction[0xEA] = &NOP;
-
-		instruction[0x09] = &ORA_Immediate;
-		instruction[0x05] = &ORA_ZP;
-		instruction[0x15] = &ORA_ZPX;
-		instruction[0x0D] = &ORA_Absolute;
-		instruction[0x1D] = &ORA_AbsoluteX;
-		instruction[0x19] = &ORA_AbsoluteY;
-		instruction[0x01] = &ORA_IndirectX;
-		instruction[0x11] = &ORA_IndirectY;
-
-		instruction[0x48] = &PHA;
-		instruction[0x08] = &PHP;
-		instruction[0x68] = &PLA;
-		instruction[0x28] = &PLP;
-
-		instruction[0x2A] = &ROL_Accumulator;
-		instruction[0x26] = &ROL_ZP;
-		instruction[0x36] = &ROL_ZPX;
-		instruction[0x2E] = &ROL_Absolute;
-		instruction[0x3E] = &ROL_AbsoluteX;
-
-		instruction[0x6A] = &ROR_Accumulator;
-		instruction[0x66] = &ROR_ZP;
-		instruction[0x76] = &ROR_ZPX;
-		instruction[0x6E] = &ROR_Absolute;
-		instruction[0x7E] = &ROR_AbsoluteX;
-
-		instruction[0x40] = &RTI;
-		instruction[0x60] = &RTS;
-
-		instruction[0xE9] = &SBC_Immediate;
-		instruction[0xE5] = &SBC_ZP;
-		instruction[0xF5] = &SBC_ZPX;
-		instruction[0xED] = &SBC_Absolute;
-		instruction[0xFD] = &SBC_AbsoluteX;
-		instruction[0xF9] = &SBC_AbsoluteY;
-		instruction[0xE1] = &SBC_IndirectX;
-		instruction[0xF1] = &SBC_IndirectY;
-
-		instruction[0x38] = &SEC;
-		instruction[0xF8] = &SED;
-		instruction[0x78] = &SEI;
-
-		instruction[0x85] = &STA_ZP;
-		instruction[0x95] = &STA_ZPX;
-		instruction[0x8D] = &STA_Absolute;
-		instruction[0x9D] = &STA_AbsoluteX;
-		instruction[0x99] = &STA_AbsoluteY;
-		instruction[0x81] = &STA_IndirectX;
-		instruction[0x91] = &STA_IndirectY;
-
-		instruction[0x86] = &STX_ZP;
-		instruction[0x96] = &STX_ZPY;
-		instruction[0x8E] = &STX_Absolute;
-
-		instruction[0x84] = &STY_ZP;
-		instruction[0x94] = &STY_ZPX;
-		instruction[0x8C] = &STY_Absolute;
-
-		instruction[0xAA] = &TAX;
-		instruction[0xA8] = &TAY;
-		instruction[0xBA] = &TSX;
-		instruction[0x8A] = &TXA;
-		instruction[0x9A] = &TXS;
-		instruction[0x98] = &TYA;
-
 		// Initialize registers to 0, except PC which is initialized to value from reset vector.
 		doRES();
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,80 @@
+#include "Scheduler.h"
+
+namespace arx65::cpu
+{
+	Scheduler::Scheduler()
+	{
+		nextId = 1;
+		preempt = false;
+	}
+
+	bool Scheduler::later(const Event &a, const Event &b)
+	{
+		return a.cycle != b.cycle ? a.cycle > b.cycle : a.id > b.id;
+	}
+
+	bool Scheduler::isCancelled(EventId id)
+	{
+		return std::find(cancelled.begin(), cancelled.end(), id) != cancelled.end();
+	}
+
+	void Scheduler::dropCancelled()
+	{
+		while (!heap.empty() && !cancelled.empty() && isCancelled(heap.front().id))
+		{
+			cancelled.erase(std::find(cancelled.begin(), cancelled.end(), heap.front().id));
+			std::pop_heap(heap.begin(), heap.end(), later);
+			heap.pop_back();
+		}
+	}
+
+	EventId Scheduler::schedule(uint64_t cycle, Callback callback)
+	{
+		if (cycle < nextDeadline()) preempt = true;
+
+		EventId id = nextId++;
+		heap.push_back({cycle, id, std::move(callback)});
+		std::push_heap(heap.begin(), heap.end(), later);
+		return id;
+	}
+
+	bool Scheduler::cancel(EventId id)
+	{
+		if (isCancelled(id)) return false;
+
+		for (const Event &event : heap)
+		{
+			if (event.id == id)
+			{
+				cancelled.push_back(id);
+				dropCancelled();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	uint64_t Scheduler::nextDeadline()
+	{
+		return heap.empty() ? UINT64_MAX : heap.front().cycle;
+	}
+
+	void Scheduler::runDue(uint64_t now)
+	{
+		while (!heap.empty() && heap.front().cycle <= now)
+		{
+			std::pop_heap(heap.begin(), heap.end(), later);
+			Event event = std::move(heap.back());
+			heap.pop_back();
+
+			// The callback may schedule or cancel, so the heap is consistent before it runs
+			event.callback(now);
+			dropCancelled();
+		}
+	}
+
+	size_t Scheduler::pending()
+	{
+		return heap.size() - cancelled.size();
+	}
+}
@@ -1,5 +1,8 @@
 #include "Common.h"
+#include "cli/Cli.h"
+#ifndef ARX65_HEADLESS
 #include "gui/GraphicsWindow.h"
+#endif
 #include "mod/SimpleMemory.h"
 #include "Databus.h"
 #include "Processor.h"
@@ -9,10 +12,14 @@ using namespace std;
 using namespace arx65;
 using namespace arx65::mod;
 
-//int mainCli(int, char*[]);
-
 int main(int argc, char *args[])
 {
+	// Subcommands run without a display
+	if (argc > 1 && cli::isCommand(args[1])) return cli::mainCli(argc, args);
 
+#ifdef ARX65_HEADLESS
+	return cli::mainCli(argc, args);
+#else
 	return GUI::mainGui(argc, args);
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,387 @@
+#include "cli/Cli.h"
+#include "mod/SimpleMemory.h"
+#include "mod/ACIA6551.h"
+
+using namespace std;
+using namespace arx65::cpu;
+using arx65::mod::SimpleMemory;
+using arx65::mod::ACIA6551;
+
+namespace arx65::cli
+{
+    // Cycles per run call, between which the ACIA output is thrown away. Short enough that the
+    // chess ROM never waits for room to print.
+    const long BENCH_BATCH_CYCLES = 10000;
+
+    // A trial that runs longer than this has gone wrong
+    const uint64_t BENCH_MAX_CYCLES = 4000000000ULL;
+
+    // The driver loop that repeats the short programs, and the zero page counter it uses
+    const uint16_t DRIVER_START = 0x0200;
+    const uint8_t DRIVER_COUNTER = 0x40;
+
+    // The sort routines take a pointer to a list at $30, whose first byte is its length. The list is
+    // copied fresh from the template before every sort.
+    const uint8_t SORT_POINTER = 0x30;
+    const uint8_t SORT_LENGTH = 0x32;
+    const uint16_t SORT_LIST = 0x0400;
+    const uint16_t SORT_TEMPLATE = 0x0500;
+
+    // Where the chess ROM prompts for a key, its ACIA and the command it sets the ACIA up with
+    const uint16_t CHESS_PROMPT = 0x1446;
+    const uint16_t CHESS_ACIA = 0x7F70;
+    const uint8_t CHESS_ACIA_COMMAND = 0x0B;
+
+    // Set up the board, then let it play against itself. P reads the same as @, which starts a move.
+    const string CHESS_INPUT = "C" + string(400, 'P');
+
+    // What a run has to leave behind to count
+    enum Result {
+        RESULT_STOP,            // Only reaching the end
+        RESULT_SORTED,          // The list sorted, the driver sets it up before every call
+        RESULT_DECIMAL          // The decimal arithmetic result in A
+    };
+
+    typedef struct {
+        const char *name;
+        const char *file;       // Image in the ROM directory
+        uint16_t address;       // Where the image is loaded
+        uint16_t entry;         // Routine the driver calls, or where the run starts without one
+        uint32_t repeat;        // Times the driver calls the routine, 0 to run it once without a driver
+        uint16_t stopPC;        // Where the run ends without a driver
+        const char *input;      // Typed at an ACIA before the run, nullptr for none
+        Result result;
+        const char *summary;
+    } Workload;
+
+    const Workload WORKLOADS[] = {
+        {"functional", "6502_functional_test.bin", 0x0000, 0x0400, 0, 0x3469, nullptr, RESULT_STOP, "Klaus Dormann's functional test to its success trap"},
+        {"bubblesort", "BubbleSort.6502.bin", 0x8000, 0x8007, 50, 0, nullptr, RESULT_SORTED, "Bubble sort of 255 random bytes, repeated"},
+        {"optimalsort", "OptimalSort.6502.bin", 0x8000, 0x8000, 100, 0, nullptr, RESULT_SORTED, "Selection sort of 255 random bytes, repeated"},
+        {"decimal", "DecimalMode.6502.bin", 0x8000, 0x8000, 300000, 0, nullptr, RESULT_DECIMAL, "Decimal mode ADC and SBC, left through BRK, repeated"},
+        {"chess", "chess.o65", 0x1000, 0x1000, 0, CHESS_PROMPT, CHESS_INPUT.c_str(), RESULT_STOP, "MicroChess playing 400 moves, over an ACIA"},
+    };
+
+    typedef struct {
+        uint64_t cycles;
+        uint64_t instructions;
+        double seconds;
+    } Trial;
+
+    static void benchUsage()
+    {
+        cerr << "Usage: arx65 bench [options]" << endl
+             << "  --workload NAME     Only run this workload, may be repeated. All of them by default." << endl
+             << "  --core NAME         table, switch, block, jit or all (default), may be repeated" << endl
+             << "  --trials N          Timed runs of each workload on each core, 5 by default" << endl
+             << "  --warmup N          Untimed runs before them, 1 by default" << endl
+             << "  --roms DIR          Where the images are, ../roms by default" << endl
+             << "  --csv               One comma separated line per workload and core on stdout" << endl
+             << "  --list              List the workloads" << endl
+             << "Each run starts from a fresh machine and is checked for the right result. The exit" << endl
+             << "code is " << EXIT_TRAPPED << " if any run was wrong." << endl;
+    }
+
+    static bool readImage(const string &path, vector<uint8_t> &image)
+    {
+        ifstream file(path, ios::in | ios::binary);
+        if (!file.is_open())
+        {
+            cerr << "Error opening '" << path << "'" << endl;
+            return false;
+        }
+        image.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        return true;
+    }
+
+    // The same pseudo-random bytes every time, so every run sorts the same list
+    static vector<uint8_t> sortTemplate()
+    {
+        vector<uint8_t> list(256);
+        uint32_t seed = 0x6502;
+        list[0] = 255;
+        for (int i = 1; i < 256; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            list[i] = seed >> 16;
+        }
+        return list;
+    }
+
+    /* Write a loop at DRIVER_START that runs setup, calls the routine and counts down, ending on a
+       JMP to itself whose address is returned. Routines that end with BRK come back to the counter
+       through the IRQ vector. */
+    static uint16_t writeDriver(SimpleMemory &ram, uint16_t entry, uint32_t repeat, const vector<uint8_t> &setup)
+    {
+        // LDX #$FF, TXS, CLD, CLV, CLC
+        vector<uint8_t> code = {0xA2, 0xFF, 0x9A, 0xD8, 0xB8, 0x18};
+        code.insert(code.end(), setup.begin(), setup.end());
+        code.insert(code.end(), {0x20, (uint8_t)(entry & 0xFF), (uint8_t)(entry >> 8)});
+
+        uint16_t next = DRIVER_START + code.size();
+        uint8_t irqVector[] = {(uint8_t)(next & 0xFF), (uint8_t)(next >> 8)};
+        ram.copyFromMemory(irqVector, 0xFFFE, 2);
+
+        // LDX #$FF, TXS, then INC and BNE back to the start on each byte of the counter
+        code.insert(code.end(), {0xA2, 0xFF, 0x9A});
+        for (int i = 0; i < 3; i++)
+        {
+            code.insert(code.end(), {0xE6, (uint8_t)(DRIVER_COUNTER + i), 0xD0});
+            code.push_back((uint8_t)(-(int)(code.size() + 1)));
+        }
+
+        uint16_t done = DRIVER_START + code.size();
+        code.insert(code.end(), {0x4C, (uint8_t)(done & 0xFF), (uint8_t)(done >> 8)});
+        ram.copyFromMemory(code.data(), DRIVER_START, code.size());
+
+        // The counter goes up from -repeat and the loop ends when it wraps to 0
+        uint32_t count = (1 << 24) - repeat;
+        uint8_t counter[] = {(uint8_t)count, (uint8_t)(count >> 8), (uint8_t)(count >> 16)};
+        ram.copyFromMemory(counter, DRIVER_COUNTER, 3);
+        return done;
+    }
+
+    /* Set up memory for a workload around its image, and return where the run starts and ends */
+    static void prepare(const Workload &workload, SimpleMemory &ram, const vector<uint8_t> &image, uint16_t &start, uint16_t &stop)
+    {
+        // copyFromMemory takes at most 64K - 1 bytes
+        for (size_t offset = 0; offset < image.size(); offset += 0x8000)
+            ram.copyFromMemory(image.data() + offset, workload.address + offset, min<size_t>(0x8000, image.size() - offset));
+
+        start = workload.entry;
+        stop = workload.stopPC;
+        if (!workload.repeat) return;
+
+        vector<uint8_t> setup;
+        if (workload.result == RESULT_SORTED)
+        {
+            vector<uint8_t> list = sortTemplate();
+            ram.copyFromMemory(list.data(), SORT_TEMPLATE, list.size());
+            uint8_t pointer[] = {SORT_LIST & 0xFF, SORT_LIST >> 8};
+            ram.copyFromMemory(pointer, SORT_POINTER, 2);
+
+            // LDX #0, LDA template,X, STA list,X, INX, BNE, then LDA #255, STA length
+            setup = {0xA2, 0x00, 0xBD, SORT_TEMPLATE & 0xFF, SORT_TEMPLATE >> 8, 0x9D, SORT_LIST & 0xFF, SORT_LIST >> 8, 0xE8, 0xD0, 0xF7,
+                     0xA9, 0xFF, 0x85, SORT_LENGTH};
+        }
+        start = DRIVER_START;
+        stop = writeDriver(ram, workload.entry, workload.repeat, setup);
+    }
+
+    /* Whether the run left the result it should */
+    static bool check(const Workload &workload, arx65::bus::Bus &bus, const RegisterSet &r)
+    {
+        if (workload.result == RESULT_SORTED)
+        {
+            vector<uint8_t> expected = sortTemplate();
+            sort(expected.begin() + 1, expected.end());
+            for (int i = 0; i < 256; i++)
+            {
+                if (bus.read(SORT_LIST + i) != expected[i]) return false;
+            }
+        }
+        else if (workload.result == RESULT_DECIMAL)
+        {
+            // $10 - $08 - 1 - $02 - $05 + $02 + 1 + $08 in BCD, starting with carry clear
+            return r.A == 0x04 && (r.Flags & FLAG_DECIMAL);
+        }
+        return true;
+    }
+
+    /* One run of a workload on a fresh machine. Only the run itself is timed. */
+    static bool runTrial(const Workload &workload, const vector<uint8_t> &image, Core core, Trial &trial)
+    {
+        SimpleMemory ram(0x0000, 0xFFFF, 0x00, false);
+        arx65::bus::Bus bus;
+        Cpu cpu(&bus);
+
+        ACIA6551 *acia = nullptr;
+        if (workload.input)
+        {
+            // Set up the way the ROM does it, so the keys are waiting before it starts
+            acia = new ACIA6551(CHESS_ACIA, &cpu);
+            acia->setUnthrottled(true);
+            acia->write(CHESS_ACIA + 2, CHESS_ACIA_COMMAND);
+            acia->sendBytes((const uint8_t *)workload.input);
+            bus.attach(acia);
+        }
+        bus.attach(&ram);
+
+        uint16_t start, stopPC;
+        prepare(workload, ram, image, start, stopPC);
+
+        cpu.init();
+        cpu.setCore(core);
+        cpu.getRegisters()->PC = start;
+
+        // With input, the end is the visit to stopPC after the last key was read
+        int visits = workload.input ? strlen(workload.input) + 1 : 1;
+        bool trapped = false;
+        uint16_t lastPC = start;
+        function<bool(const RegisterSet &)> stop = [&](const RegisterSet &r) {
+            if (r.PC == stopPC && --visits == 0) return true;
+            if (r.PC == lastPC && isTrap(bus, r.PC)) return trapped = true;
+            lastPC = r.PC;
+            return false;
+        };
+
+        auto started = chrono::steady_clock::now();
+        while (visits > 0 && !trapped && cpu.getCycles() < BENCH_MAX_CYCLES)
+        {
+            if (acia)
+            {
+                uint8_t discard[4096];
+                while (acia->drainBytes(discard, sizeof(discard)) > 0) ;
+            }
+            cpu.runUntil(stop, BENCH_BATCH_CYCLES);
+        }
+        trial.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        trial.cycles = cpu.getCycles();
+        trial.instructions = cpu.getInstructions();
+
+        bool passed = visits == 0 && check(workload, bus, *cpu.getRegisters());
+        bus.clear();
+        delete acia;
+        return passed;
+    }
+
+    static void meanAndDeviation(const vector<double> &values, double &mean, double &deviation)
+    {
+        mean = accumulate(values.begin(), values.end(), 0.0) / values.size();
+        double squares = 0;
+        for (double value : values) squares += (value - mean) * (value - mean);
+        deviation = values.size() > 1 ? sqrt(squares / (values.size() - 1)) : 0;
+    }
+
+    int benchCommand(int argc, char *args[])
+    {
+        vector<const Workload *> workloads;
+        vector<Core> cores;
+        uint64_t trials = 5, warmup = 1;
+        string romDir = "../roms";
+        bool csv = false;
+
+        for (int i = 0; i < argc; i++)
+        {
+            string option = args[i];
+            bool hasValue = i + 1 < argc;
+            string value = hasValue ? args[i + 1] : "";
+
+            if (option == "--help")
+            {
+                benchUsage();
+                return EXIT_STOPPED;
+            }
+            else if (option == "--list")
+            {
+                for (const Workload &workload : WORKLOADS)
+                    cout << setfill(' ') << setw(14) << left << workload.name << workload.summary << endl;
+                return EXIT_STOPPED;
+            }
+            else if (option == "--csv") csv = true;
+            else if (!hasValue)
+            {
+                cerr << "Unknown option or missing value: " << option << endl;
+                benchUsage();
+                return EXIT_SETUP;
+            }
+            else
+            {
+                i++;
+                if (option == "--workload")
+                {
+                    const Workload *found = nullptr;
+                    for (const Workload &workload : WORKLOADS)
+                    {
+                        if (value == workload.name) found = &workload;
+                    }
+                    if (!found)
+                    {
+                        cerr << "Unknown workload '" << value << "', see --list" << endl;
+                        return EXIT_SETUP;
+                    }
+                    workloads.push_back(found);
+                }
+                else if (option == "--core")
+                {
+                    Core core;
+                    if (value == "all") cores.insert(cores.end(), {CORE_TABLE, CORE_SWITCH, CORE_BLOCK, CORE_JIT});
+                    else if (parseCore(value, core)) cores.push_back(core);
+                    else return EXIT_SETUP;
+                }
+                else if (option == "--trials") { if (!parseNumber(value, trials) || trials == 0) return EXIT_SETUP; }
+                else if (option == "--warmup") { if (!parseNumber(value, warmup)) return EXIT_SETUP; }
+                else if (option == "--roms") romDir = value;
+                else
+                {
+                    cerr << "Unknown option: " << option << endl;
+                    benchUsage();
+                    return EXIT_SETUP;
+                }
+            }
+        }
+
+        if (workloads.empty())
+        {
+            for (const Workload &workload : WORKLOADS) workloads.push_back(&workload);
+        }
+        if (cores.empty()) cores = {CORE_TABLE, CORE_SWITCH, CORE_BLOCK, CORE_JIT};
+
+        const char *coreNames[] = {"table", "switch", "block", "jit"};
+        if (csv)
+            cout << "workload,core,trials,instructions,cycles,mips_mean,mips_stddev,mhz_mean,mhz_stddev,"
+                 << "ns_per_instruction_mean,ns_per_instruction_stddev,ns_per_instruction_min,passed" << endl;
+        else
+            cout << setfill(' ') << left << setw(13) << "workload" << setw(8) << "core" << right
+                 << setw(13) << "instructions" << setw(13) << "cycles"
+                 << setw(18) << "MIPS" << setw(18) << "MHz" << setw(18) << "ns/instruction" << endl;
+
+        bool allPassed = true;
+        for (const Workload *workload : workloads)
+        {
+            vector<uint8_t> image;
+            if (!readImage(romDir + "/" + workload->file, image)) return EXIT_SETUP;
+
+            for (Core core : cores)
+            {
+                Trial trial;
+                bool passed = true;
+                for (uint64_t i = 0; i < warmup; i++) passed &= runTrial(*workload, image, core, trial);
+
+                vector<double> mips, mhz, nanoseconds;
+                for (uint64_t i = 0; i < trials; i++)
+                {
+                    passed &= runTrial(*workload, image, core, trial);
+                    mips.push_back(trial.instructions / trial.seconds / 1e6);
+                    mhz.push_back(trial.cycles / trial.seconds / 1e6);
+                    nanoseconds.push_back(trial.seconds * 1e9 / trial.instructions);
+                }
+
+                if (!passed)
+                    cerr << "Wrong result for " << workload->name << " on the " << coreNames[core] << " core" << endl;
+                allPassed &= passed;
+
+                double mipsMean, mipsDev, mhzMean, mhzDev, nsMean, nsDev;
+                meanAndDeviation(mips, mipsMean, mipsDev);
+                meanAndDeviation(mhz, mhzMean, mhzDev);
+                meanAndDeviation(nanoseconds, nsMean, nsDev);
+                double nsMin = *min_element(nanoseconds.begin(), nanoseconds.end());
+
+                if (csv)
+                    cout << workload->name << "," << coreNames[core] << "," << trials << ","
+                         << trial.instructions << "," << trial.cycles << "," << fixed << setprecision(3)
+                         << mipsMean << "," << mipsDev << "," << mhzMean << "," << mhzDev << ","
+                         << nsMean << "," << nsDev << "," << nsMin << "," << (passed ? 1 : 0) << endl;
+                else
+                    cout << left << setw(13) << workload->name << setw(8) << coreNames[core] << right
+                         << setw(13) << trial.instructions << setw(13) << trial.cycles << fixed << setprecision(2)
+                         << setw(10) << mipsMean << " +-" << setw(5) << mipsDev
+                         << setw(10) << mhzMean << " +-" << setw(5) << mhzDev
+                         << setw(10) << nsMean << " +-" << setw(5) << nsDev
+                         << (passed ? "" : "  WRONG") << endl;
+            }
+        }
+
+        return allPassed ? EXIT_STOPPED : EXIT_TRAPPED;
+    }
+}
@@ -0,0 +1,104 @@
+#include "cli/Cli.h"
+
+using namespace std;
+using namespace arx65::cpu;
+
+namespace arx65::cli
+{
+    typedef struct {
+        const char *name;
+        int (*command)(int argc, char *args[]);
+        const char *summary;
+    } Command;
+
+    const Command COMMANDS[] = {
+        {"run", runCommand, "Run images headless, with an ACIA on stdio, until a trap, PC or cycle limit"},
+        {"bench", benchCommand, "Time the bundled ROMs on each core, with the spread over repeated trials"},
+        {"micro", microCommand, "Time a tight loop of every legal opcode on each core"},
+        {"klaus", klausCommand, "Run Klaus Dormann's functional test on each core, report failures and MIPS"},
+        {"vectors", vectorsCommand, "Check single instruction test vectors in the SingleStepTests JSON format"},
+    };
+
+    static void usage()
+    {
+        cerr << "Usage: arx65 [--clock MHz]          Open the terminal window" << endl
+             << "       arx65 <command> [options]    Run without a display" << endl << endl
+             << "Commands:" << endl;
+        for (const Command &command : COMMANDS)
+            cerr << "  " << setfill(' ') << setw(10) << left << command.name << command.summary << endl;
+        cerr << endl << "Use arx65 <command> --help for its options." << endl;
+    }
+
+    bool isCommand(const char *name)
+    {
+        for (const Command &command : COMMANDS)
+        {
+            if (strcmp(command.name, name) == 0) return true;
+        }
+        return strcmp(name, "help") == 0 || strcmp(name, "--help") == 0;
+    }
+
+    int mainCli(int argc, char *args[])
+    {
+        for (const Command &command : COMMANDS)
+        {
+            if (argc > 1 && strcmp(command.name, args[1]) == 0) return command.command(argc - 2, args + 2);
+        }
+        usage();
+        return argc > 1 && (strcmp(args[1], "help") == 0 || strcmp(args[1], "--help") == 0) ? EXIT_STOPPED : EXIT_SETUP;
+    }
+
+    bool parseNumber(const string &text, uint64_t &value)
+    {
+        const char *digits = text.c_str();
+        int base = 10;
+        if (text.size() > 1 && text[0] == '$') { digits++; base = 16; }
+        else if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) { digits += 2; base = 16; }
+
+        char *end;
+        errno = 0;
+        value = strtoull(digits, &end, base);
+        if (*digits == '\0' || *end != '\0' || errno)
+        {
+            cerr << "Not a number: '" << text << "'" << endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool parseAddress(const string &text, uint16_t &address)
+    {
+        uint64_t value;
+        if (!parseNumber(text, value)) return false;
+        if (value > 0xFFFF)
+        {
+            cerr << "Address out of range: '" << text << "'" << endl;
+            return false;
+        }
+        address = value;
+        return true;
+    }
+
+    bool parseCore(const string &text, Core &core)
+    {
+        if (text == "table") core = CORE_TABLE;
+        else if (text == "switch") core = CORE_SWITCH;
+        else if (text == "block") core = CORE_BLOCK;
+        else if (text == "jit") core = CORE_JIT;
+        else
+        {
+            cerr << "Unknown core '" << text << "', use table, switch, block or jit" << endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool isTrap(arx65::bus::Bus &bus, uint16_t pc)
+    {
+        uint8_t opcode = bus.read(pc);
+        if (opcode == 0x4C) return bus.read16(pc + 1) == pc;
+
+        // Every branch opcode is xxx10000, and an offset of -2 lands on the branch again
+        return (opcode & 0x1F) == 0x10 && bus.read(pc + 1) == 0xFE;
+    }
+}
@@ -0,0 +1,149 @@
+#include "cli/Cli.h"
+#include "mod/SimpleMemory.h"
+
+using namespace std;
+using namespace arx65::cpu;
+using arx65::mod::SimpleMemory;
+
+namespace arx65::cli
+{
+    // Where the bundled build of Klaus Dormann's functional test starts, passes, and keeps the
+    // number of the test it is in
+    const uint16_t KLAUS_ENTRY = 0x0400;
+    const uint16_t KLAUS_SUCCESS = 0x3469;
+    const uint16_t KLAUS_TEST_CASE = 0x0200;
+
+    // The whole test is about 96 million cycles
+    const uint64_t KLAUS_MAX_CYCLES = 200000000;
+
+    // Cycles per run call, between which the cycle limit is checked
+    const long KLAUS_BATCH_CYCLES = 10000000;
+
+    static void klausUsage()
+    {
+        cerr << "Usage: arx65 klaus [options]" << endl
+             << "  --rom FILE          The test image, ../roms/6502_functional_test.bin by default" << endl
+             << "  --success ADDR      The trap it passes at, $" << HEX(4, KLAUS_SUCCESS) << " by default" << endl
+             << "  --core NAME         table, switch, block, jit or all (default), may be repeated" << endl
+             << "  --max-cycles N      Give up after N cycles, " << KLAUS_MAX_CYCLES << " by default" << endl
+             << "  --jit-check         Run every compiled block of the jit core again in the interpreter and" << endl
+             << "                      fail if any disagreed. Much slower." << endl
+             << "Runs Klaus Dormann's 6502 functional test from $" << HEX(4, KLAUS_ENTRY) << " until it traps, which is a JMP or" << endl
+             << "branch to itself. The exit code is " << EXIT_STOPPED << " if every core passed, " << EXIT_TRAPPED << " if one trapped anywhere" << endl
+             << "else or a compiled block disagreed with --jit-check, and " << EXIT_LIMIT << " if one ran out of cycles." << endl;
+    }
+
+    int klausCommand(int argc, char *args[])
+    {
+        string romPath = "../roms/6502_functional_test.bin";
+        uint16_t success = KLAUS_SUCCESS;
+        uint64_t maxCycles = KLAUS_MAX_CYCLES;
+        vector<Core> cores;
+        bool jitCheck = false;
+
+        for (int i = 0; i < argc; i++)
+        {
+            string option = args[i];
+            bool hasValue = i + 1 < argc;
+            string value = hasValue ? args[i + 1] : "";
+
+            if (option == "--help")
+            {
+                klausUsage();
+                return EXIT_STOPPED;
+            }
+            else if (option == "--jit-check") jitCheck = true;
+            else if (!hasValue)
+            {
+                cerr << "Unknown option or missing value: " << option << endl;
+                klausUsage();
+                return EXIT_SETUP;
+            }
+            else
+            {
+                i++;
+                if (option == "--rom") romPath = value;
+                else if (option == "--success") { if (!parseAddress(value, success)) return EXIT_SETUP; }
+                else if (option == "--max-cycles") { if (!parseNumber(value, maxCycles)) return EXIT_SETUP; }
+                else if (option == "--core")
+                {
+                    Core core;
+                    if (value == "all") cores.insert(cores.end(), {CORE_TABLE, CORE_SWITCH, CORE_BLOCK, CORE_JIT});
+                    else if (parseCore(value, core)) cores.push_back(core);
+                    else return EXIT_SETUP;
+                }
+                else
+                {
+                    cerr << "Unknown option: " << option << endl;
+                    klausUsage();
+                    return EXIT_SETUP;
+                }
+            }
+        }
+        if (cores.empty()) cores = {CORE_TABLE, CORE_SWITCH, CORE_BLOCK, CORE_JIT};
+
+        const char *coreNames[] = {"table", "switch", "block", "jit"};
+        int result = EXIT_STOPPED;
+
+        for (Core core : cores)
+        {
+            SimpleMemory ram(0x0000, 0xFFFF, 0x00, false);
+            if (!ram.loadFromFile(romPath.c_str(), 0x0000)) return EXIT_SETUP;
+
+            arx65::bus::Bus bus;
+            Cpu cpu(&bus);
+            bus.attach(&ram);
+            cpu.init();
+            cpu.setJitDifferential(jitCheck);
+            cpu.setCore(core);
+            cpu.getRegisters()->PC = KLAUS_ENTRY;
+
+            // A trap runs the same instruction, or with the jit core the same block, twice in a
+            // row. Only then is memory looked at.
+            uint16_t lastPC = KLAUS_ENTRY;
+            bool trapped = false;
+            function<bool(const RegisterSet &)> stop = [&](const RegisterSet &r) {
+                if (r.PC == lastPC && isTrap(bus, r.PC)) return trapped = true;
+                lastPC = r.PC;
+                return false;
+            };
+
+            auto started = chrono::steady_clock::now();
+            while (!trapped && cpu.getCycles() < maxCycles)
+                cpu.runUntil(stop, min<uint64_t>(KLAUS_BATCH_CYCLES, maxCycles - cpu.getCycles()));
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+            const RegisterSet &r = *cpu.getRegisters();
+            cout << setfill(' ') << left << setw(8) << coreNames[core];
+            if (!trapped)
+            {
+                cout << "GAVE UP in test $" << HEX(2, bus.read(KLAUS_TEST_CASE)) << " at $" << HEX(4, r.PC);
+                result = max(result, EXIT_LIMIT);
+            }
+            else if (r.PC != success)
+            {
+                cout << "FAILED test $" << HEX(2, bus.read(KLAUS_TEST_CASE)) << " at $" << HEX(4, r.PC)
+                     << "  A=" << HEX(2, r.A) << " X=" << HEX(2, r.X) << " Y=" << HEX(2, r.Y)
+                     << " P=" << HEX(2, r.Flags) << " SP=" << HEX(2, r.SP);
+                result = max(result, EXIT_TRAPPED);
+            }
+            else
+                cout << "passed";
+
+            cout << ", " << cpu.getInstructions() << " instructions, " << cpu.getCycles() << " cycles in "
+                 << fixed << setprecision(3) << seconds << " s, " << setprecision(2)
+                 << cpu.getInstructions() / seconds / 1000000 << " MIPS, "
+                 << cpu.getCycles() / seconds / 1000000 << " MHz" << endl;
+
+            if (cpu.getJitMismatches())
+            {
+                cout << setfill(' ') << setw(8) << "" << cpu.getJitMismatches() << " compiled blocks disagreed with the interpreter" << endl;
+                result = max(result, EXIT_TRAPPED);
+            }
+
+            bus.clear();
+        }
+
+        return result;
+    }
+}
@@ -0,0 +1,310 @@
+#include "cli/Cli.h"
+#include "mod/SimpleMemory.h"
+
+using namespace std;
+using namespace arx65::cpu;
+using arx65::mod::SimpleMemory;
+
+namespace arx65::cli
+{
+    // Where the loop goes, the subroutine JSR and BRK go to, and the JMP (indirect) pointers
+    const uint16_t MICRO_CODE = 0x1000;
+    const uint16_t MICRO_SUBROUTINE = 0x2000;
+    const uint16_t MICRO_POINTERS = 0x0200;
+
+    // Operands. The indexed modes run with X and Y at MICRO_INDEX, so from MICRO_CROSSING they
+    // carry into the next page. (zp,X) reads its pointer from MICRO_POINTER as well.
+    const uint8_t MICRO_ZP = 0x80;
+    const uint8_t MICRO_POINTER = 0xF0;
+    const uint16_t MICRO_DATA = 0x0300;
+    const uint16_t MICRO_CROSSING = 0x03F8;
+    const uint8_t MICRO_INDEX = 0x10;
+
+    // Copies of the instruction in the loop, which ends with a JMP back
+    const int MICRO_COPIES = 16;
+
+    const uint8_t OP_NOP = 0xEA;
+
+    /* One loop to time: an opcode, and what the machine looks like while it runs */
+    typedef struct {
+        uint8_t opcode;
+        OpcodeInfo info;
+        uint8_t flags;          // Status register throughout the loop
+        bool crossing;          // Indexed operands carry into the next page
+        uint8_t pairedWith;     // Second opcode of each copy, for the ones that have to return, or 0
+        const char *variant;
+    } Micro;
+
+    typedef struct {
+        double cycles;          // Per copy, without the JMP
+        double nanoseconds;     // Per copy, the JMP shared out between the copies
+    } MicroResult;
+
+    static void microUsage()
+    {
+        cerr << "Usage: arx65 micro [options]" << endl
+             << "  --op NAME           Only time this mnemonic, or opcode in hex, may be repeated" << endl
+             << "  --core NAME         table, switch, block, jit or all (default), may be repeated" << endl
+             << "  --cycles N          Cycles each loop is timed for, 1000000 by default" << endl
+             << "  --trials N          Timed runs of each loop, of which the fastest counts, 3 by default" << endl
+             << "  --sort              Most expensive first on the first core, instead of by opcode" << endl
+             << "  --csv               One comma separated line per loop and core on stdout" << endl
+             << "Each legal opcode runs " << MICRO_COPIES << " times in a row in a loop. Branches are timed taken and" << endl
+             << "not taken, the indexed modes with and without a page crossing, ADC and SBC in decimal" << endl
+             << "mode too. JSR is timed with RTS and BRK with RTI, each pair as one." << endl;
+    }
+
+    static string instructionName(const Micro &micro)
+    {
+        if (micro.pairedWith) return string(micro.info.name) + "+" + getOpcodeInfo(micro.pairedWith).name;
+        string syntax = modeSyntax(micro.info.mode);
+        return syntax.empty() ? micro.info.name : micro.info.name + (" " + syntax);
+    }
+
+    /* Every loop there is for one opcode */
+    static void addMicros(uint8_t opcode, vector<Micro> &micros)
+    {
+        OpcodeInfo info = getOpcodeInfo(opcode);
+        Micro micro = {opcode, info, 0, false, 0, ""};
+        string name = info.name;
+
+        // These only make sense after a JSR or BRK
+        if (name == "RTS" || name == "RTI") return;
+
+        if (name == "JSR") micro.pairedWith = 0x60;
+        if (name == "BRK") micro.pairedWith = 0x40;
+
+        if (info.mode == MODE_RELATIVE)
+        {
+            // Branches are xxy10000, taken when the flag picked by xx equals y
+            const uint8_t FLAGS[] = {FLAG_NEGATIVE, FLAG_OVERFLOW, FLAG_CARRY, FLAG_ZERO};
+            uint8_t flag = FLAGS[opcode >> 6];
+            bool whenSet = opcode & 0x20;
+
+            micro.flags = whenSet ? flag : 0;
+            micro.variant = "taken";
+            micros.push_back(micro);
+            micro.flags = whenSet ? 0 : flag;
+            micro.variant = "not taken";
+            micros.push_back(micro);
+            return;
+        }
+
+        micros.push_back(micro);
+
+        if (info.mode == MODE_ABSOLUTEX || info.mode == MODE_ABSOLUTEY || info.mode == MODE_INDIRECTY)
+        {
+            micro.crossing = true;
+            micro.variant = "page crossing";
+            micros.push_back(micro);
+        }
+        else if ((name == "ADC" || name == "SBC") && info.mode == MODE_IMMEDIATE)
+        {
+            micro.flags = FLAG_DECIMAL;
+            micro.variant = "decimal";
+            micros.push_back(micro);
+        }
+    }
+
+    /* Set up memory for the loop, which starts at MICRO_CODE */
+    static void writeMicro(const Micro &micro, SimpleMemory &ram)
+    {
+        // LDX #index, LDY #index, then the flags through LDA #flags, PHA, PLP
+        vector<uint8_t> code = {0xA2, MICRO_INDEX, 0xA0, MICRO_INDEX, 0xA9, micro.flags, 0x48, 0x28};
+        uint16_t loop = MICRO_CODE + code.size();
+
+        uint16_t data = micro.crossing ? MICRO_CROSSING : MICRO_DATA;
+        uint8_t pointer[] = {(uint8_t)(data & 0xFF), (uint8_t)(data >> 8)};
+        ram.copyFromMemory(pointer, MICRO_POINTER, 2);
+
+        // JSR and BRK come back from here
+        uint8_t subroutine[] = {micro.pairedWith};
+        ram.copyFromMemory(subroutine, MICRO_SUBROUTINE, 1);
+        uint8_t irqVector[] = {MICRO_SUBROUTINE & 0xFF, MICRO_SUBROUTINE >> 8};
+        ram.copyFromMemory(irqVector, 0xFFFE, 2);
+
+        for (int i = 0; i < MICRO_COPIES; i++)
+        {
+            uint16_t next = MICRO_CODE + code.size() + micro.info.length;
+            uint16_t operand = 0;
+            switch (micro.info.mode)
+            {
+            case MODE_ZP: case MODE_ZPX: case MODE_ZPY: operand = MICRO_ZP; break;
+            case MODE_ABSOLUTE: operand = micro.opcode == 0x4C ? next : micro.opcode == 0x20 ? MICRO_SUBROUTINE : MICRO_DATA; break;
+            case MODE_ABSOLUTEX: case MODE_ABSOLUTEY: operand = data; break;
+            case MODE_INDIRECTX: operand = MICRO_POINTER - MICRO_INDEX; break;
+            case MODE_INDIRECTY: operand = MICRO_POINTER; break;
+            case MODE_IMMEDIATE: operand = 0x01; break;
+            case MODE_INDIRECT:
+            {
+                // Each JMP has a pointer of its own to the next copy
+                operand = MICRO_POINTERS + i * 2;
+                uint8_t target[] = {(uint8_t)(next & 0xFF), (uint8_t)(next >> 8)};
+                ram.copyFromMemory(target, operand, 2);
+                break;
+            }
+            default: break;     // Branches go to the next instruction, taken or not
+            }
+
+            code.push_back(micro.opcode);
+            if (micro.info.length > 1) code.push_back(operand & 0xFF);
+            if (micro.info.length > 2) code.push_back(operand >> 8);
+        }
+
+        code.insert(code.end(), {0x4C, (uint8_t)(loop & 0xFF), (uint8_t)(loop >> 8)});
+        ram.copyFromMemory(code.data(), MICRO_CODE, code.size());
+    }
+
+    /* Time one loop on a fresh machine, after an untimed run so the block and JIT cores have
+       decoded and compiled it */
+    static MicroResult runMicro(const Micro &micro, Core core, long cycles, int trials)
+    {
+        SimpleMemory ram(0x0000, 0xFFFF, 0x00, false);
+        arx65::bus::Bus bus;
+        Cpu cpu(&bus);
+        bus.attach(&ram);
+
+        writeMicro(micro, ram);
+        cpu.init();
+        cpu.setCore(core);
+        cpu.getRegisters()->PC = MICRO_CODE;
+        cpu.runCycles(cycles / 10);
+
+        MicroResult best = {0, 0};
+        for (int i = 0; i < trials; i++)
+        {
+            uint64_t cyclesBefore = cpu.getCycles(), instructionsBefore = cpu.getInstructions();
+            auto started = chrono::steady_clock::now();
+            cpu.runCycles(cycles);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+            // Each pass of the loop is the copies and the JMP, 3 cycles
+            int perCopy = micro.pairedWith ? 2 : 1;
+            double passes = (double)(cpu.getInstructions() - instructionsBefore) / (MICRO_COPIES * perCopy + 1);
+            double nanoseconds = seconds * 1e9 / (passes * MICRO_COPIES);
+            if (i == 0 || nanoseconds < best.nanoseconds)
+                best = {((cpu.getCycles() - cyclesBefore) - passes * 3) / (passes * MICRO_COPIES), nanoseconds};
+        }
+
+        bus.clear();
+        return best;
+    }
+
+    int microCommand(int argc, char *args[])
+    {
+        vector<string> ops;
+        vector<Core> cores;
+        uint64_t cycles = 1000000, trials = 3;
+        bool csv = false, sortByCost = false;
+
+        for (int i = 0; i < argc; i++)
+        {
+            string option = args[i];
+            bool hasValue = i + 1 < argc;
+            string value = hasValue ? args[i + 1] : "";
+
+            if (option == "--help")
+            {
+                microUsage();
+                return EXIT_STOPPED;
+            }
+            else if (option == "--csv") csv = true;
+            else if (option == "--sort") sortByCost = true;
+            else if (!hasValue)
+            {
+                cerr << "Unknown option or missing value: " << option << endl;
+                microUsage();
+                return EXIT_SETUP;
+            }
+            else
+            {
+                i++;
+                if (option == "--op")
+                {
+                    transform(value.begin(), value.end(), value.begin(), ::toupper);
+                    ops.push_back(value);
+                }
+                else if (option == "--core")
+                {
+                    Core core;
+                    if (value == "all") cores.insert(cores.end(), {CORE_TABLE, CORE_SWITCH, CORE_BLOCK, CORE_JIT});
+                    else if (parseCore(value, core)) cores.push_back(core);
+                    else return EXIT_SETUP;
+                }
+                else if (option == "--cycles") { if (!parseNumber(value, cycles) || cycles == 0 || cycles > LONG_MAX) return EXIT_SETUP; }
+                else if (option == "--trials") { if (!parseNumber(value, trials) || trials == 0) return EXIT_SETUP; }
+                else
+                {
+                    cerr << "Unknown option: " << option << endl;
+                    microUsage();
+                    return EXIT_SETUP;
+                }
+            }
+        }
+        if (cores.empty()) cores = {CORE_TABLE, CORE_SWITCH, CORE_BLOCK, CORE_JIT};
+
+        // NOP is always timed, everything is also given relative to it
+        vector<Micro> micros;
+        addMicros(OP_NOP, micros);
+        for (int opcode = 0; opcode < 256; opcode++)
+        {
+            OpcodeInfo info = getOpcodeInfo(opcode);
+            if (!info.name || opcode == OP_NOP) continue;
+
+            stringstream hex;
+            hex << HEX(2, opcode);
+            if (ops.empty() || find(ops.begin(), ops.end(), info.name) != ops.end() || find(ops.begin(), ops.end(), hex.str()) != ops.end()
+                || find(ops.begin(), ops.end(), "0X" + hex.str()) != ops.end() || find(ops.begin(), ops.end(), "$" + hex.str()) != ops.end())
+                addMicros(opcode, micros);
+        }
+
+        vector<vector<MicroResult>> results(micros.size());
+        for (size_t i = 0; i < micros.size(); i++)
+        {
+            for (Core core : cores) results[i].push_back(runMicro(micros[i], core, cycles, trials));
+        }
+
+        vector<size_t> order(micros.size());
+        iota(order.begin(), order.end(), 0);
+        if (sortByCost)
+            stable_sort(order.begin() + 1, order.end(), [&](size_t a, size_t b) { return results[a][0].nanoseconds > results[b][0].nanoseconds; });
+
+        const char *coreNames[] = {"table", "switch", "block", "jit"};
+        if (csv)
+            cout << "opcode,instruction,variant,core,cycles,ns_per_instruction,relative_to_nop" << endl;
+        else
+        {
+            cout << "ns per instruction, and relative to NOP" << endl
+                 << setfill(' ') << left << setw(4) << "op" << setw(28) << "instruction" << right << setw(7) << "cycles";
+            for (Core core : cores) cout << setw(16) << coreNames[core];
+            cout << endl;
+        }
+
+        for (size_t i : order)
+        {
+            const Micro &micro = micros[i];
+            if (!csv)
+            {
+                stringstream op;
+                op << HEX(2, micro.opcode);
+                cout << left << setw(4) << op.str() << setw(28) << instructionName(micro) + (*micro.variant ? string(" ") + micro.variant : "") << right << fixed << setprecision(1)
+                     << setw(7) << results[i][0].cycles;
+            }
+
+            for (size_t c = 0; c < cores.size(); c++)
+            {
+                double relative = results[i][c].nanoseconds / results[0][c].nanoseconds;
+                if (csv)
+                    cout << HEX(2, micro.opcode) << "," << instructionName(micro) << "," << micro.variant << "," << coreNames[cores[c]] << "," << fixed << setprecision(2)
+                         << results[i][c].cycles << "," << setprecision(3) << results[i][c].nanoseconds << ","
+                         << relative << endl;
+                else
+                    cout << setprecision(2) << setw(9) << results[i][c].nanoseconds << " x" << left << setw(5) << setprecision(1)
+                         << relative << right;
+            }
+            if (!csv) cout << endl;
+        }
+
+        return EXIT_STOPPED;
+    }
+}
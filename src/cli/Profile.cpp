@@ -0,0 +1,146 @@
+#include "cli/Cli.h"
+
+using namespace std;
+using namespace arx65::cpu;
+
+namespace arx65::cli
+{
+    const char *modeSyntax(Mode mode)
+    {
+        switch (mode)
+        {
+        case MODE_ACCUMULATOR: return "A";
+        case MODE_IMMEDIATE: return "#imm";
+        case MODE_ZP: return "zp";
+        case MODE_ZPX: return "zp,X";
+        case MODE_ZPY: return "zp,Y";
+        case MODE_ABSOLUTE: return "abs";
+        case MODE_ABSOLUTEX: return "abs,X";
+        case MODE_ABSOLUTEY: return "abs,Y";
+        case MODE_INDIRECT: return "(abs)";
+        case MODE_INDIRECTX: return "(zp,X)";
+        case MODE_INDIRECTY: return "(zp),Y";
+        case MODE_RELATIVE: return "rel";
+        default: return "";
+        }
+    }
+
+    string disassemble(arx65::bus::Bus &bus, uint16_t pc)
+    {
+        // Bytes outside plain memory are left alone, reading a device could change its state
+        auto peek = [&](uint16_t address, uint8_t &byte) {
+            if (!bus.isDirectRead(address)) return false;
+            byte = bus.read(address);
+            return true;
+        };
+
+        uint8_t opcode, low = 0, high = 0;
+        if (!peek(pc, opcode)) return "???";
+
+        OpcodeInfo info = getOpcodeInfo(opcode);
+        ostringstream text;
+        if (info.name == nullptr)
+        {
+            text << ".byte $" << HEX(2, opcode);
+            return text.str();
+        }
+        if ((info.length > 1 && !peek(pc + 1, low)) || (info.length > 2 && !peek(pc + 2, high)))
+        {
+            text << info.name << " ???";
+            return text.str();
+        }
+
+        uint16_t word = low | (high << 8);
+        text << info.name;
+        switch (info.mode)
+        {
+        case MODE_ACCUMULATOR: text << " A"; break;
+        case MODE_IMMEDIATE: text << " #$" << HEX(2, low); break;
+        case MODE_ZP: text << " $" << HEX(2, low); break;
+        case MODE_ZPX: text << " $" << HEX(2, low) << ",X"; break;
+        case MODE_ZPY: text << " $" << HEX(2, low) << ",Y"; break;
+        case MODE_ABSOLUTE: text << " $" << HEX(4, word); break;
+        case MODE_ABSOLUTEX: text << " $" << HEX(4, word) << ",X"; break;
+        case MODE_ABSOLUTEY: text << " $" << HEX(4, word) << ",Y"; break;
+        case MODE_INDIRECT: text << " ($" << HEX(4, word) << ")"; break;
+        case MODE_INDIRECTX: text << " ($" << HEX(2, low) << ",X)"; break;
+        case MODE_INDIRECTY: text << " ($" << HEX(2, low) << "),Y"; break;
+        case MODE_RELATIVE: text << " $" << HEX(4, (uint16_t)(pc + 2 + (int8_t)low)); break;
+        default: break;
+        }
+        return text.str();
+    }
+
+    /* Indices of the nonzero entries, the most cycles first */
+    static vector<unsigned int> byCycles(const uint64_t *executions, const uint64_t *cycles, unsigned int count)
+    {
+        vector<unsigned int> order;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            if (executions[i]) order.push_back(i);
+        }
+        stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return cycles[a] > cycles[b]; });
+        return order;
+    }
+
+    static string opcodeName(uint8_t opcode)
+    {
+        OpcodeInfo info = getOpcodeInfo(opcode);
+        ostringstream text;
+        if (info.name == nullptr) text << ".byte $" << HEX(2, opcode);
+        else if (*modeSyntax(info.mode)) text << info.name << " " << modeSyntax(info.mode);
+        else text << info.name;
+        return text.str();
+    }
+
+    void writeProfileText(const Profile &profile, arx65::bus::Bus &bus, ostream &out, size_t top)
+    {
+        uint64_t executions = accumulate(profile.opcodeExecutions, profile.opcodeExecutions + 256, (uint64_t)0);
+        uint64_t cycles = accumulate(profile.opcodeCycles, profile.opcodeCycles + 256, (uint64_t)0);
+        double total = cycles ? cycles : 1;
+
+        vector<unsigned int> pcs = byCycles(profile.executions, profile.cycles, 65536);
+        out << "Profile of " << executions << " instructions, " << cycles << " cycles, "
+            << pcs.size() << " addresses" << endl << endl;
+
+        out << setfill(' ') << left << setw(8) << "address" << right << setw(14) << "cycles" << setw(8) << "%"
+            << setw(14) << "executions" << setw(9) << "cyc/ex" << "  instruction" << endl;
+        for (size_t i = 0; i < pcs.size() && i < top; i++)
+        {
+            uint16_t pc = pcs[i];
+            out << "$" << HEX(4, pc) << setfill(' ') << "   " << setw(14) << profile.cycles[pc] << fixed
+                << setprecision(2) << setw(8) << profile.cycles[pc] * 100 / total << setw(14) << profile.executions[pc]
+                << setw(9) << (double)profile.cycles[pc] / profile.executions[pc] << "  " << disassemble(bus, pc) << endl;
+        }
+        if (pcs.size() > top) out << "... " << pcs.size() - top << " more" << endl;
+
+        vector<unsigned int> opcodes = byCycles(profile.opcodeExecutions, profile.opcodeCycles, 256);
+        out << endl << left << setw(8) << "opcode" << setw(12) << "mnemonic" << right << setw(14) << "cycles" << setw(8) << "%"
+            << setw(14) << "executions" << setw(9) << "cyc/ex" << endl;
+        for (unsigned int opcode : opcodes)
+        {
+            out << "$" << HEX(2, opcode) << setfill(' ') << "     " << left << setw(12) << opcodeName(opcode) << right
+                << setw(14) << profile.opcodeCycles[opcode] << fixed << setprecision(2)
+                << setw(8) << profile.opcodeCycles[opcode] * 100 / total << setw(14) << profile.opcodeExecutions[opcode]
+                << setw(9) << (double)profile.opcodeCycles[opcode] / profile.opcodeExecutions[opcode] << endl;
+        }
+    }
+
+    void writeProfileCsv(const Profile &profile, arx65::bus::Bus &bus, ostream &out)
+    {
+        // The instruction is quoted, operands have commas in them
+        out << "kind,key,executions,cycles,cycles_per_execution,instruction" << endl;
+        for (unsigned int pc : byCycles(profile.executions, profile.cycles, 65536))
+        {
+            out << "address,$" << HEX(4, pc) << "," << profile.executions[pc] << "," << profile.cycles[pc] << ","
+                << fixed << setprecision(3) << (double)profile.cycles[pc] / profile.executions[pc] << ","
+                << "\"" << disassemble(bus, pc) << "\"" << endl;
+        }
+        for (unsigned int opcode : byCycles(profile.opcodeExecutions, profile.opcodeCycles, 256))
+        {
+            out << "opcode,$" << HEX(2, opcode) << "," << profile.opcodeExecutions[opcode] << "," << profile.opcodeCycles[opcode] << ","
+                << fixed << setprecision(3) << (double)profile.opcodeCycles[opcode] / profile.opcodeExecutions[opcode] << ","
+                << "\"" << opcodeName(opcode) << "\"" << endl;
+        }
+    }
+}
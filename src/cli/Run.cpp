@@ -0,0 +1,324 @@
+#include "cli/Cli.h"
+#include "mod/SimpleMemory.h"
+#include "mod/ACIA6551.h"
+#include "sys/SerialBridge.h"
+#include "sys/ClockGovernor.h"
+
+using namespace std;
+using namespace arx65::cpu;
+using namespace arx65::sys;
+using arx65::mod::SimpleMemory;
+using arx65::mod::ACIA6551;
+
+namespace arx65::cli
+{
+    // Cycles per run call, between which the serial bridge is serviced
+    const long BATCH_CYCLES = 100000;
+
+    // Host time between catching up with the clock when paced
+    const chrono::milliseconds PACING_SLICE(4);
+
+    // Addresses listed in a profile report
+    const uint64_t PROFILE_TOP = 40;
+
+    static void runUsage()
+    {
+        cerr << "Usage: arx65 run [options]" << endl
+             << "  --load FILE@ADDR    Load a binary image at an address, may be repeated" << endl
+             << "  --vectors ADDR      Point the NMI, reset and IRQ vectors at ADDR" << endl
+             << "  --entry ADDR        Start at ADDR instead of the reset vector" << endl
+             << "  --acia ADDR         Attach an ACIA6551 at ADDR, bridged to the host" << endl
+             << "  --serial MODE       stdio (default), pty, or socket:PATH. A terminal on stdio stays" << endl
+             << "                      line-buffered, use pty for single keys." << endl
+             << "  --throttle          Keep the ACIA to its baud rate, it is unthrottled by default" << endl
+             << "  --clock MHz         Pace to a clock rate, unlimited by default" << endl
+             << "  --core NAME         table, switch, block or jit (default)" << endl
+             << "  --max-cycles N      Stop after N cycles, exit code " << EXIT_LIMIT << endl
+             << "  --stop-pc ADDR      Stop when the PC reaches ADDR, exit code " << EXIT_STOPPED << ". May be repeated." << endl
+             << "  --trap              Stop at a JMP or branch to itself, exit code " << EXIT_TRAPPED << endl
+             << "                      unless it is at a --stop-pc address" << endl
+             << "  --profile FILE      Count cycles per address and opcode, write a report to FILE, - for stderr" << endl
+             << "  --profile-csv FILE  The same as CSV, every address that ran" << endl
+             << "  --profile-top N     Addresses in the --profile report, " << PROFILE_TOP << " by default" << endl
+             << "  --jit-check         Run every compiled block of the jit core again in the interpreter, exit" << endl
+             << "                      code " << EXIT_TRAPPED << " or higher if any disagreed. Much slower." << endl
+             << "  --quiet             No summary on stderr" << endl
+             << "Numbers are decimal, or hex with a $ or 0x prefix. With the jit core, PC conditions" << endl
+             << "are only checked between compiled blocks, so a --stop-pc must start a block. Profiling runs" << endl
+             << "the jit core without its compiled code." << endl;
+    }
+
+    // Write a report to a file, or to stderr for -, since stdout may be the serial line
+    static bool writeReport(const string &path, const function<void(ostream &)> &write)
+    {
+        if (path.empty()) return true;
+        if (path == "-")
+        {
+            write(cerr);
+            return true;
+        }
+
+        ofstream file(path);
+        if (!file)
+        {
+            cerr << "Could not write " << path << endl;
+            return false;
+        }
+        write(file);
+        return true;
+    }
+
+    int runCommand(int argc, char *args[])
+    {
+        typedef struct {
+            string path;
+            uint16_t address;
+        } Image;
+
+        vector<Image> images;
+        vector<uint16_t> stopPCs;
+        bool setVectors = false, setEntry = false, useAcia = false, throttle = false, trap = false, quiet = false, jitCheck = false;
+        uint16_t vectors = 0, entry = 0, aciaAddress = 0;
+        BridgeMode mode = BRIDGE_STDIO;
+        string socketPath;
+        double mhz = 0;
+        Core core = CORE_JIT;
+        uint64_t maxCycles = 0;
+        string profilePath, profileCsvPath;
+        uint64_t profileTop = PROFILE_TOP;
+
+        for (int i = 0; i < argc; i++)
+        {
+            string option = args[i];
+            bool hasValue = i + 1 < argc;
+            string value = hasValue ? args[i + 1] : "";
+
+            if (option == "--help")
+            {
+                runUsage();
+                return EXIT_STOPPED;
+            }
+            else if (option == "--throttle") throttle = true;
+            else if (option == "--trap") trap = true;
+            else if (option == "--jit-check") jitCheck = true;
+            else if (option == "--quiet") quiet = true;
+            else if (!hasValue)
+            {
+                cerr << "Unknown option or missing value: " << option << endl;
+                runUsage();
+                return EXIT_SETUP;
+            }
+            else
+            {
+                i++;
+                if (option == "--load")
+                {
+                    size_t at = value.rfind('@');
+                    Image image;
+                    if (at == string::npos || !parseAddress(value.substr(at + 1), image.address))
+                    {
+                        cerr << "Expected FILE@ADDR: '" << value << "'" << endl;
+                        return EXIT_SETUP;
+                    }
+                    image.path = value.substr(0, at);
+                    images.push_back(image);
+                }
+                else if (option == "--vectors") { if (!parseAddress(value, vectors)) return EXIT_SETUP; setVectors = true; }
+                else if (option == "--entry") { if (!parseAddress(value, entry)) return EXIT_SETUP; setEntry = true; }
+                else if (option == "--acia") { if (!parseAddress(value, aciaAddress)) return EXIT_SETUP; useAcia = true; }
+                else if (option == "--core") { if (!parseCore(value, core)) return EXIT_SETUP; }
+                else if (option == "--max-cycles") { if (!parseNumber(value, maxCycles)) return EXIT_SETUP; }
+                else if (option == "--clock") mhz = atof(value.c_str());
+                else if (option == "--profile") profilePath = value;
+                else if (option == "--profile-csv") profileCsvPath = value;
+                else if (option == "--profile-top") { if (!parseNumber(value, profileTop)) return EXIT_SETUP; }
+                else if (option == "--stop-pc")
+                {
+                    uint16_t pc;
+                    if (!parseAddress(value, pc)) return EXIT_SETUP;
+                    stopPCs.push_back(pc);
+                }
+                else if (option == "--serial")
+                {
+                    if (value == "stdio") mode = BRIDGE_STDIO;
+                    else if (value == "pty") mode = BRIDGE_PTY;
+                    else if (value.compare(0, 7, "socket:") == 0)
+                    {
+                        mode = BRIDGE_SOCKET;
+                        socketPath = value.substr(7);
+                    }
+                    else
+                    {
+                        cerr << "Unknown serial mode '" << value << "', use stdio, pty or socket:PATH" << endl;
+                        return EXIT_SETUP;
+                    }
+                }
+                else
+                {
+                    cerr << "Unknown option: " << option << endl;
+                    runUsage();
+                    return EXIT_SETUP;
+                }
+            }
+        }
+
+#ifdef ARX65_NO_PROFILE
+        if (!profilePath.empty() || !profileCsvPath.empty())
+        {
+            cerr << "Profiling was left out of this build" << endl;
+            return EXIT_SETUP;
+        }
+#endif
+
+        // The whole 64K is RAM, devices attached before it take their addresses over
+        SimpleMemory ram(0x0000, 0xFFFF, 0x00, false);
+        for (const Image &image : images)
+        {
+            if (!ram.loadFromFile(image.path.c_str(), image.address)) return EXIT_SETUP;
+        }
+        if (setVectors)
+        {
+            uint8_t vects[] = {(uint8_t)(vectors & 0xFF), (uint8_t)(vectors >> 8), (uint8_t)(vectors & 0xFF), (uint8_t)(vectors >> 8), (uint8_t)(vectors & 0xFF), (uint8_t)(vectors >> 8)};
+            ram.copyFromMemory(vects, 0xFFFA, 6);
+        }
+
+        arx65::bus::Bus bus;
+        Cpu cpu(&bus);
+
+        ACIA6551 *acia = nullptr;
+        SerialBridge *bridge = nullptr;
+        if (useAcia)
+        {
+            acia = new ACIA6551(aciaAddress, &cpu, mhz > 0 ? mhz * 1000000 : 1000000);
+            acia->setUnthrottled(!throttle);
+            bus.attach(acia);
+        }
+        bus.attach(&ram);
+
+        cpu.init();
+        cpu.setJitDifferential(jitCheck);
+        cpu.setCore(core);
+        if (setEntry) cpu.getRegisters()->PC = entry;
+
+        if (acia)
+        {
+            bridge = new SerialBridge(acia);
+            if (!bridge->open(mode, socketPath))
+            {
+                delete bridge;
+                delete acia;
+                return EXIT_SETUP;
+            }
+            if (mode != BRIDGE_STDIO) cerr << "Serial on " << bridge->getName() << endl;
+        }
+
+        Profile *profile = nullptr;
+        if (!profilePath.empty() || !profileCsvPath.empty())
+        {
+            profile = new Profile();
+            cpu.setProfile(profile);
+        }
+
+        // Stop conditions, checked after every instruction, or compiled block with the jit core
+        enum { RUNNING, STOPPED, TRAPPED, LIMIT } reason = RUNNING;
+        uint16_t lastPC = cpu.getRegisters()->PC;
+        function<bool(const RegisterSet &)> stop = [&](const RegisterSet &r) {
+            for (uint16_t pc : stopPCs)
+            {
+                if (r.PC == pc)
+                {
+                    reason = STOPPED;
+                    return true;
+                }
+            }
+            if (trap && r.PC == lastPC && isTrap(bus, r.PC))
+            {
+                reason = TRAPPED;
+                return true;
+            }
+            lastPC = r.PC;
+            return false;
+        };
+        bool checkStops = trap || !stopPCs.empty();
+
+        ClockGovernor governor(mhz);
+        auto started = ClockGovernor::Clock::now();
+        auto deadline = started;
+
+        while (reason == RUNNING)
+        {
+            if (bridge) bridge->service();
+
+            long budget = BATCH_CYCLES;
+            if (maxCycles)
+            {
+                uint64_t left = maxCycles > cpu.getCycles() ? maxCycles - cpu.getCycles() : 0;
+                if (left == 0)
+                {
+                    reason = LIMIT;
+                    break;
+                }
+                budget = min<uint64_t>(budget, left);
+            }
+
+            if (!governor.isUnlimited())
+            {
+                long due = governor.cyclesUntil(deadline);
+                if (due == 0)
+                {
+                    governor.sleepUntil(deadline);
+                    deadline += PACING_SLICE;
+                    continue;
+                }
+                budget = min(budget, due);
+            }
+
+            governor.account(checkStops ? cpu.runUntil(stop, budget) : cpu.runCycles(budget));
+        }
+
+        double seconds = chrono::duration<double>(ClockGovernor::Clock::now() - started).count();
+
+        // The reports disassemble through the bus, so they are written while the ACIA is still on it
+        bool reported = true;
+        if (profile)
+        {
+            reported = writeReport(profilePath, [&](ostream &out) { writeProfileText(*profile, bus, out, profileTop); })
+                && writeReport(profileCsvPath, [&](ostream &out) { writeProfileCsv(*profile, bus, out); });
+            delete profile;
+        }
+
+        // Hand over the last output before the bridge goes, as long as the host keeps taking it
+        if (bridge)
+        {
+            auto giveUp = ClockGovernor::Clock::now() + chrono::seconds(1);
+            while (acia->bytesAvailable() && ClockGovernor::Clock::now() < giveUp)
+            {
+                bridge->service();
+                this_thread::yield();
+            }
+            bridge->close();
+            delete bridge;
+        }
+        delete acia;
+
+        if (!quiet)
+        {
+            const RegisterSet &r = *cpu.getRegisters();
+            const char *why = reason == STOPPED ? "reached stop PC" : reason == TRAPPED ? "trapped" : "cycle limit";
+            cerr << "Stopped: " << why << " at $" << HEX(4, r.PC)
+                 << "  A=" << HEX(2, r.A) << " X=" << HEX(2, r.X) << " Y=" << HEX(2, r.Y)
+                 << " P=" << HEX(2, r.Flags) << " SP=" << HEX(2, r.SP) << endl
+                 << cpu.getCycles() << " cycles, " << cpu.getInstructions() << " instructions in "
+                 << fixed << setprecision(3) << seconds << " s, "
+                 << setprecision(2) << cpu.getCycles() / seconds / 1000000 << " MHz, "
+                 << cpu.getInstructions() / seconds / 1000000 << " MIPS" << endl;
+        }
+
+        if (cpu.getJitMismatches())
+            cerr << cpu.getJitMismatches() << " compiled blocks disagreed with the interpreter" << endl;
+
+        if (!reported) return EXIT_SETUP;
+        int result = reason == STOPPED ? EXIT_STOPPED : reason == TRAPPED ? EXIT_TRAPPED : EXIT_LIMIT;
+        return cpu.getJitMismatches() ? max(result, EXIT_TRAPPED) : result;
+    }
+}
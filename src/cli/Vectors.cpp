@@ -0,0 +1,522 @@
+#include "cli/Cli.h"
+#include "mod/SimpleMemory.h"
+
+#include <filesystem>
+#include <mutex>
+
+using namespace std;
+using namespace arx65::cpu;
+using arx65::mod::SimpleMemory;
+
+namespace arx65::cli
+{
+    // Bytes read from a vector file at a time
+    const size_t VECTOR_BUFFER_SIZE = 1 << 20;
+
+    // The B flag and bit 5 only exist on the stack, the tests disagree on what the register holds
+    const uint8_t VECTOR_FLAG_MASK = 0xCF;
+
+    /* Machine state in a test vector */
+    typedef struct {
+        RegisterSet registers;
+        vector<pair<uint16_t, uint8_t>> ram;
+    } VectorState;
+
+    /* One instruction to run. Only the number of bus cycles is kept, not what they were. */
+    typedef struct {
+        string name;
+        VectorState initial, final;
+        int cycles;
+    } TestVector;
+
+    /* Outcome for one opcode */
+    typedef struct {
+        uint64_t passed;
+        uint64_t failed;            // Registers or memory differ, the cycles may too
+        uint64_t cycleFailed;       // Only the cycles returned by the handler differ
+        vector<string> examples;    // The first failures, described
+    } OpcodeResult;
+
+    /* Pulls test vectors out of a JSON array as it reads the file, so a file never has to be in
+       memory at once. Only understands as much JSON as the test vectors use: no escapes in strings,
+       integer numbers only. Keys are only told apart by their first KEY_SIZE - 1 characters. */
+    class VectorReader
+    {
+    private:
+        FILE *file;
+        vector<char> buffer;
+        const char *cursor, *end;
+        size_t consumed;
+        bool started;
+        string error;
+
+        // Room for the longest key that is looked at
+        static const int KEY_SIZE = 8;
+
+        bool fill()
+        {
+            consumed += end - buffer.data();
+            size_t length = fread(buffer.data(), 1, buffer.size(), file);
+            cursor = buffer.data();
+            end = cursor + length;
+            return length > 0;
+        }
+
+        bool more()
+        {
+            return cursor < end || fill();
+        }
+
+        // The next character that is not white space, without taking it
+        int peek()
+        {
+            while (more())
+            {
+                if (*cursor > ' ') return *cursor;
+                cursor++;
+            }
+            return EOF;
+        }
+
+        bool fail(const char *what)
+        {
+            if (error.empty())
+            {
+                stringstream message;
+                message << what << " at byte " << consumed + (cursor - buffer.data());
+                error = message.str();
+            }
+            return false;
+        }
+
+        bool expect(char c)
+        {
+            if (peek() != c) return fail("Unexpected character");
+            cursor++;
+            return true;
+        }
+
+        // Takes a ',' and returns true if another element follows, or takes close
+        bool another(char close, bool &ok)
+        {
+            int c = peek();
+            if (c == EOF) return ok = fail("Unexpected end of file");
+            cursor++;
+            if (c == ',') return true;
+            ok = c == close || fail("Expected ',' or the end of an array or object");
+            return false;
+        }
+
+        template <typename Store>
+        bool readString(Store store)
+        {
+            if (!expect('"')) return false;
+            while (more())
+            {
+                const char *start = cursor;
+                while (cursor < end && *cursor != '"' && *cursor != '\\') cursor++;
+                store(start, cursor - start);
+                if (cursor == end) continue;
+                if (*cursor++ == '"') return true;
+                return fail("Escapes in strings are not supported");
+            }
+            return fail("Unterminated string");
+        }
+
+        bool readKey(char *key)
+        {
+            int length = 0;
+            return readString([&](const char *text, size_t size) {
+                size = min<size_t>(size, KEY_SIZE - 1 - length);
+                memcpy(key + length, text, size);
+                length += size;
+                key[length] = '\0';
+            }) && expect(':');
+        }
+
+        bool readNumber(long &value)
+        {
+            bool negative = peek() == '-';
+            if (negative) cursor++;
+            if (!more() || *cursor < '0' || *cursor > '9') return fail("Expected a number");
+
+            value = 0;
+            while (more() && *cursor >= '0' && *cursor <= '9') value = value * 10 + *cursor++ - '0';
+            if (negative) value = -value;
+            return true;
+        }
+
+        // Anything that is not needed, such as what each bus cycle was. Arrays and objects are only
+        // scanned for their end, counting the elements of the outermost one into elements.
+        bool skipValue(int *elements = nullptr)
+        {
+            int c = peek();
+            if (c == EOF) return fail("Unexpected end of file");
+            if (c != '[' && c != '{' && c != '"')
+            {
+                // true, false, null and numbers
+                while (more() && *cursor > ' ' && *cursor != ',' && *cursor != ']' && *cursor != '}') cursor++;
+                return true;
+            }
+
+            int depth = 0, count = 0;
+            bool inString = false, empty = true;
+            while (more())
+            {
+                char c = *cursor++;
+                if (inString)
+                {
+                    if (c == '\\' && more()) cursor++;
+                    else if (c == '"') inString = false;
+                    if (depth == 0 && !inString) return true;
+                    continue;
+                }
+                switch (c)
+                {
+                case '"': inString = true; empty = false; break;
+                case '[': case '{': if (++depth > 1) empty = false; break;
+                case ']': case '}':
+                    if (--depth == 0)
+                    {
+                        if (elements) *elements = empty ? 0 : count + 1;
+                        return true;
+                    }
+                    break;
+                case ',': if (depth == 1) count++; break;
+                default: if (c > ' ') empty = false;
+                }
+            }
+            return fail("Unexpected end of file");
+        }
+
+        bool readState(VectorState &state)
+        {
+            state.ram.clear();
+            if (!expect('{')) return false;
+
+            char key[KEY_SIZE];
+            bool ok = true;
+            do
+            {
+                long value;
+                if (!readKey(key)) return false;
+                if (strcmp(key, "ram") == 0)
+                {
+                    if (!expect('[')) return false;
+                    if (peek() == ']') cursor++;
+                    else do
+                    {
+                        long address, byte;
+                        if (!expect('[') || !readNumber(address) || !expect(',') || !readNumber(byte) || !expect(']')) return false;
+                        state.ram.push_back({(uint16_t)address, (uint8_t)byte});
+                    } while (another(']', ok));
+                    if (!ok) return false;
+                    continue;
+                }
+
+                uint8_t *target = nullptr;
+                if (strcmp(key, "pc") == 0)
+                {
+                    if (!readNumber(value)) return false;
+                    state.registers.PC = value;
+                    continue;
+                }
+                else if (strcmp(key, "s") == 0) target = &state.registers.SP;
+                else if (strcmp(key, "a") == 0) target = &state.registers.A;
+                else if (strcmp(key, "x") == 0) target = &state.registers.X;
+                else if (strcmp(key, "y") == 0) target = &state.registers.Y;
+                else if (strcmp(key, "p") == 0) target = &state.registers.Flags;
+
+                if (!target)
+                {
+                    if (!skipValue()) return false;
+                }
+                else
+                {
+                    if (!readNumber(value)) return false;
+                    *target = value;
+                }
+            } while (another('}', ok));
+            return ok;
+        }
+
+    public:
+        VectorReader(FILE *file) : file(file), buffer(VECTOR_BUFFER_SIZE)
+        {
+            cursor = end = buffer.data();
+            consumed = 0;
+            started = false;
+        }
+
+        // Read the next vector. Returns false at the end of the array, or with getError() set.
+        bool next(TestVector &vector)
+        {
+            int c = peek();
+            if (!started)
+            {
+                started = true;
+                if (!expect('[')) return false;
+                if (peek() == ']') return false;
+            }
+            else if (c == ']') return false;
+            else if (c != ',') return fail("Expected ',' or ']'");
+            else cursor++;
+
+            if (!expect('{')) return false;
+            vector.cycles = 0;
+
+            char key[KEY_SIZE];
+            bool ok = true;
+            do
+            {
+                if (!readKey(key)) return false;
+                bool read;
+                if (strcmp(key, "name") == 0)
+                {
+                    vector.name.clear();
+                    read = readString([&](const char *text, size_t size) { vector.name.append(text, size); });
+                }
+                else if (strcmp(key, "initial") == 0) read = readState(vector.initial);
+                else if (strcmp(key, "final") == 0) read = readState(vector.final);
+                else if (strcmp(key, "cycles") == 0) read = skipValue(&vector.cycles);
+                else read = skipValue();
+                if (!read) return false;
+            } while (another('}', ok));
+            return ok;
+        }
+
+        const string &getError()
+        {
+            return error;
+        }
+    };
+
+    static void vectorsUsage()
+    {
+        cerr << "Usage: arx65 vectors [options] PATH..." << endl
+             << "  PATH                A JSON file of test vectors, or a directory of them" << endl
+             << "  --core NAME         table, switch (default), block or jit" << endl
+             << "  --threads N         Machines running files side by side, one per hardware thread by default" << endl
+             << "  --examples N        Failures described per opcode, 3 by default" << endl
+             << "  --verbose           A line for every opcode, not only those that failed" << endl
+             << "Runs single instruction test vectors in the format of the SingleStepTests (ProcessorTests)" << endl
+             << "6502 set: an array of objects with a name, the initial and final registers and RAM, and the" << endl
+             << "bus cycles. Checks the registers, the RAM and that the handler returned as many cycles." << endl
+             << "Files are shared out between the threads, so a single file runs on one of them. Opcodes" << endl
+             << "that are not legal are skipped. The exit code is " << EXIT_TRAPPED << " if any vector failed." << endl;
+    }
+
+    static string describeRegisters(const RegisterSet &r)
+    {
+        stringstream text;
+        text << "PC=" << HEX(4, r.PC) << " A=" << HEX(2, r.A) << " X=" << HEX(2, r.X) << " Y=" << HEX(2, r.Y)
+             << " P=" << HEX(2, r.Flags) << " SP=" << HEX(2, r.SP);
+        return text.str();
+    }
+
+    /* Run one vector on a machine whose memory holds whatever the previous ones left. Every
+       address the instruction touches is in the initial RAM, so nothing else matters. */
+    static void runVector(const TestVector &vector, Cpu &cpu, SimpleMemory &ram, OpcodeResult &result, uint64_t examples)
+    {
+        for (auto &cell : vector.initial.ram) ram.write(cell.first, cell.second);
+        if (cpu.getCore() == CORE_BLOCK || cpu.getCore() == CORE_JIT) cpu.invalidateCode();
+        *cpu.getRegisters() = vector.initial.registers;
+
+        int cycles = cpu.doNextInstruction();
+
+        const RegisterSet &r = *cpu.getRegisters(), &expected = vector.final.registers;
+        bool registersMatch = r.PC == expected.PC && r.A == expected.A && r.X == expected.X && r.Y == expected.Y
+            && r.SP == expected.SP && (r.Flags & VECTOR_FLAG_MASK) == (expected.Flags & VECTOR_FLAG_MASK);
+
+        bool memoryMatches = true;
+        for (auto &cell : vector.final.ram) memoryMatches &= ram.read(cell.first) == cell.second;
+
+        if (registersMatch && memoryMatches && cycles == vector.cycles)
+        {
+            result.passed++;
+            return;
+        }
+
+        if (registersMatch && memoryMatches) result.cycleFailed++;
+        else result.failed++;
+
+        if (result.examples.size() < examples)
+        {
+            stringstream text;
+            text << "\"" << vector.name << "\":";
+            if (!registersMatch) text << " " << describeRegisters(r) << ", expected " << describeRegisters(expected) << ";";
+            for (auto &cell : vector.final.ram)
+            {
+                uint8_t byte = ram.read(cell.first);
+                if (byte != cell.second) text << " $" << HEX(4, cell.first) << "=" << HEX(2, byte) << " not " << HEX(2, cell.second);
+            }
+            if (cycles != vector.cycles) text << " " << cycles << " cycles, expected " << vector.cycles;
+            result.examples.push_back(text.str());
+        }
+    }
+
+    int vectorsCommand(int argc, char *args[])
+    {
+        vector<string> paths;
+        Core core = CORE_SWITCH;
+        uint64_t threads = max(1u, thread::hardware_concurrency()), examples = 3;
+        bool verbose = false;
+
+        for (int i = 0; i < argc; i++)
+        {
+            string option = args[i];
+            bool hasValue = i + 1 < argc;
+            string value = hasValue ? args[i + 1] : "";
+
+            if (option == "--help")
+            {
+                vectorsUsage();
+                return EXIT_STOPPED;
+            }
+            else if (option == "--verbose") verbose = true;
+            else if (option.compare(0, 2, "--") != 0) paths.push_back(option);
+            else if (!hasValue)
+            {
+                cerr << "Unknown option or missing value: " << option << endl;
+                vectorsUsage();
+                return EXIT_SETUP;
+            }
+            else
+            {
+                i++;
+                if (option == "--core") { if (!parseCore(value, core)) return EXIT_SETUP; }
+                else if (option == "--threads") { if (!parseNumber(value, threads) || threads == 0) return EXIT_SETUP; }
+                else if (option == "--examples") { if (!parseNumber(value, examples)) return EXIT_SETUP; }
+                else
+                {
+                    cerr << "Unknown option: " << option << endl;
+                    vectorsUsage();
+                    return EXIT_SETUP;
+                }
+            }
+        }
+
+        // Directories stand for the JSON files in them
+        vector<string> files;
+        for (const string &path : paths)
+        {
+            error_code error;
+            if (filesystem::is_directory(path, error))
+            {
+                for (const auto &entry : filesystem::directory_iterator(path, error))
+                {
+                    if (entry.path().extension() == ".json") files.push_back(entry.path().string());
+                }
+            }
+            else files.push_back(path);
+        }
+        sort(files.begin(), files.end());
+        if (files.empty())
+        {
+            cerr << "No test vector files given" << endl;
+            vectorsUsage();
+            return EXIT_SETUP;
+        }
+        threads = min<uint64_t>(threads, files.size());
+
+        // Each thread takes the next file that is left and keeps results of its own
+        atomic<size_t> nextFile(0);
+        atomic<uint64_t> skipped(0);
+        atomic<bool> broken(false);
+        mutex errors;
+        vector<vector<OpcodeResult>> results(threads, vector<OpcodeResult>(256));
+
+        auto worker = [&](int index) {
+            SimpleMemory ram(0x0000, 0xFFFF, 0x00, false);
+            arx65::bus::Bus bus;
+            Cpu cpu(&bus);
+            bus.attach(&ram);
+            cpu.init();
+            cpu.setCore(core);
+
+            TestVector vector;
+            for (size_t f = nextFile++; f < files.size(); f = nextFile++)
+            {
+                FILE *file = fopen(files[f].c_str(), "rb");
+                if (!file)
+                {
+                    lock_guard<mutex> lock(errors);
+                    cerr << "Error opening '" << files[f] << "'" << endl;
+                    broken = true;
+                    continue;
+                }
+
+                VectorReader reader(file);
+                while (reader.next(vector))
+                {
+                    // The opcode is the first byte of the instruction in the initial RAM
+                    auto opcode = find_if(vector.initial.ram.begin(), vector.initial.ram.end(),
+                        [&](const pair<uint16_t, uint8_t> &cell) { return cell.first == vector.initial.registers.PC; });
+                    if (opcode == vector.initial.ram.end() || !getOpcodeInfo(opcode->second).name)
+                    {
+                        skipped++;
+                        continue;
+                    }
+                    runVector(vector, cpu, ram, results[index][opcode->second], examples);
+                }
+                fclose(file);
+
+                if (!reader.getError().empty())
+                {
+                    lock_guard<mutex> lock(errors);
+                    cerr << files[f] << ": " << reader.getError() << endl;
+                    broken = true;
+                }
+            }
+            bus.clear();
+        };
+
+        auto started = chrono::steady_clock::now();
+        vector<thread> running;
+        for (uint64_t i = 0; i < threads; i++) running.emplace_back(worker, i);
+        for (thread &t : running) t.join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+        // Put the threads' results together, by opcode
+        uint64_t passed = 0, failed = 0, cycleFailed = 0;
+        for (int opcode = 0; opcode < 256; opcode++)
+        {
+            OpcodeResult total = {0, 0, 0, {}};
+            for (auto &perThread : results)
+            {
+                OpcodeResult &result = perThread[opcode];
+                total.passed += result.passed;
+                total.failed += result.failed;
+                total.cycleFailed += result.cycleFailed;
+                for (string &example : result.examples)
+                {
+                    if (total.examples.size() < examples) total.examples.push_back(example);
+                }
+            }
+            passed += total.passed;
+            failed += total.failed;
+            cycleFailed += total.cycleFailed;
+
+            uint64_t run = total.passed + total.failed + total.cycleFailed;
+            if (run == 0 || (!verbose && total.passed == run)) continue;
+
+            OpcodeInfo info = getOpcodeInfo(opcode);
+            cout << HEX(2, opcode) << " " << info.name << ": " << total.passed << " of " << run << " passed";
+            if (total.failed) cout << ", " << total.failed << " wrong";
+            if (total.cycleFailed) cout << ", " << total.cycleFailed << " only wrong in cycles";
+            cout << endl;
+            for (string &example : total.examples) cout << "    " << example << endl;
+        }
+
+        uint64_t run = passed + failed + cycleFailed;
+        cout << passed << " of " << run << " vectors passed";
+        if (failed) cout << ", " << failed << " wrong";
+        if (cycleFailed) cout << ", " << cycleFailed << " only wrong in cycles";
+        if (skipped) cout << ", " << skipped << " skipped for opcodes that are not legal";
+        cout << ". " << files.size() << " files, " << threads << (threads == 1 ? " thread, " : " threads, ") << fixed << setprecision(2) << seconds
+             << " s, " << setprecision(0) << run / seconds << " vectors/s" << endl;
+
+        if (broken) return EXIT_SETUP;
+        return passed == run ? EXIT_STOPPED : EXIT_TRAPPED;
+    }
+}
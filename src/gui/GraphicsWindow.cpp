@@ -2,10 +2,13 @@
 #include "gui/GraphicsWindow.h"
 #include "sys/ISystem.h"
 #include "sys/Terminal.h"
+#include "sys/EmulationThread.h"
 
 using namespace std;
 using arx65::sys::ISystem;
 using arx65::sys::Terminal;
+using arx65::sys::ClockGovernor;
+using arx65::sys::EmulationThread;
 
 namespace arx65::GUI
 {
@@ -20,6 +23,12 @@ namespace arx65::GUI
     // Screen refresh rate
     const double FRAMERATE = 60;
 
+    // In turbo only one frame in this many is drawn
+    const int TURBO_FRAME_SKIP = 8;
+
+    // Emulated clock in MHz unless given with --clock, 0 runs as fast as the host allows
+    const double DEFAULT_CLOCK_MHZ = 1.0;
+
     // Common SDL variables
     SDL_Window *window;
     SDL_Renderer *renderer;
@@ -27,20 +36,36 @@ namespace arx65::GUI
     // Active system
     ISystem *system;
 
+    // Runs the active system, paced to its clock rate
+    EmulationThread *emulation;
+
     /* Main entrypoint is here */
     int mainGui(int argc, char *args[])
     {
         // Initialize SDL
         if (!initializeSdl()) return -1;
 
+        double mhz = DEFAULT_CLOCK_MHZ;
+        for (int i = 1; i + 1 < argc; i++)
+        {
+            if (string(args[i]) == "--clock") mhz = atof(args[++i]);
+        }
+
         //TODO
         // Maybe here we can parse arguments and decide which system we want to set up.
-        system = (ISystem *)new Terminal(80, 48);
+        system = (ISystem *)new Terminal(80, 48, mhz);
         system->init();
 
+        emulation = new EmulationThread(system, mhz);
+        emulation->start();
+
         // Start main program loop
         loop();
 
+        // The system must not be running while it goes away
+        emulation->stop();
+        delete emulation;
+
         // De-initialize the active system? Probably won't actually do this here
         system->deinit();
 
@@ -120,14 +145,17 @@ namespace arx65::GUI
         return true;
     }
 
-    /* The main program loop runs here. */
+    /* The main program loop runs here. The system runs on the emulation thread, this one only
+       passes it input and draws what it published. */
     int loop()
     {
         bool doLoop = true;
         SDL_Event e;
         
-        auto nextDraw = chrono::high_resolution_clock::now();
-        long first = nextDraw.time_since_epoch().count();
+        const auto frame = chrono::duration_cast<ClockGovernor::Clock::duration>(chrono::duration<double>(1 / FRAMERATE));
+        auto nextDraw = ClockGovernor::Clock::now();
+        int skipped = 0;
+        string report;
 
         while (doLoop)
         {
@@ -143,28 +171,27 @@ namespace arx65::GUI
                 else if(e.type == SDL_TEXTINPUT)
                     system->keyTypeEvent(e.text.text);
             }
-            
-            // Now, perform regular update
-            system->tick(0);
 
             // Now, update the screen by passing the current drawing surface.
             // Note that even though most of the time, it doesn't change, it's possible for the 
             // surface to change without predictability, such as window size change, etc.
-            auto now = chrono::high_resolution_clock::now();
-            if (now > nextDraw)
+            if (!system->isTurbo() || ++skipped >= TURBO_FRAME_SKIP)
             {
-                //cout << "New frame. " << (now.time_since_epoch().count() - first) / 1000 << endl;
-                
+                skipped = 0;
                 SDL_RenderClear(renderer);
 
                 system->drawGraphics(renderer, 0);
                 
                 SDL_RenderPresent(renderer);
-                
-                // Update when we should next draw.
-                while (nextDraw < now) nextDraw += chrono::nanoseconds((int)(1000000000 / FRAMERATE));
             }
-            
+
+            if (emulation->nextReport(report))
+                SDL_SetWindowTitle(window, ("arx65 - " + report).c_str());
+
+            // Sleep until the next frame. Frames the host could not keep up with are skipped.
+            auto now = ClockGovernor::Clock::now();
+            while (nextDraw <= now) nextDraw += frame;
+            this_thread::sleep_until(nextDraw);
         }
 
         return 0;
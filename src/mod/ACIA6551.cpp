@@ -3,11 +3,108 @@
 
 namespace arx65::mod
 {
-    ACIA6551::ACIA6551(uint16_t address)
+    // Status register bits
+    const uint8_t STATUS_OVERRUN = 0x04;
+    const uint8_t STATUS_RECEIVE_FULL = 0x08;
+    const uint8_t STATUS_TRANSMIT_EMPTY = 0x10;
+    const uint8_t STATUS_NO_CARRIER = 0x20;
+    const uint8_t STATUS_NOT_READY = 0x40;
+    const uint8_t STATUS_IRQ = 0x80;
+
+    // Command register bits
+    const uint8_t COMMAND_DTR = 0x01;
+    const uint8_t COMMAND_IRQ_DISABLE = 0x02;
+    const uint8_t COMMAND_ECHO = 0x10;
+    const uint8_t COMMAND_PARITY = 0x20;
+
+    // Baud rates of the control register's low nibble. 0 is the external clock, which runs instantly here.
+    const double BAUD_RATES[16] = {0, 50, 75, 109.92, 134.58, 150, 300, 600, 1200, 1800, 2400, 3600, 4800, 7200, 9600, 19200};
+
+    ByteFifo::ByteFifo()
+    {
+        clear();
+    }
+
+    int ByteFifo::size()
+    {
+        return count;
+    }
+
+    int ByteFifo::space()
+    {
+        return CAPACITY - count;
+    }
+
+    bool ByteFifo::empty()
+    {
+        return count == 0;
+    }
+
+    bool ByteFifo::full()
+    {
+        return count == CAPACITY;
+    }
+
+    void ByteFifo::clear()
+    {
+        head = 0;
+        count = 0;
+    }
+
+    bool ByteFifo::push(uint8_t byte)
+    {
+        if (full()) return false;
+        data[(head + count++) % CAPACITY] = byte;
+        return true;
+    }
+
+    uint8_t ByteFifo::pop()
+    {
+        uint8_t x = data[head];
+        head = (head + 1) % CAPACITY;
+        count--;
+        return x;
+    }
+
+    int ByteFifo::push(const uint8_t *bytes, int len)
+    {
+        len = std::min(len, space());
+
+        // Up to the end of the array, then from its start
+        int tail = (head + count) % CAPACITY;
+        int first = std::min(len, CAPACITY - tail);
+        memcpy(data + tail, bytes, first);
+        memcpy(data, bytes + first, len - first);
+        count += len;
+        return len;
+    }
+
+    int ByteFifo::pop(uint8_t *bytes, int len)
+    {
+        len = std::min(len, count);
+
+        int first = std::min(len, CAPACITY - head);
+        memcpy(bytes, data + head, first);
+        memcpy(bytes + first, data, len - first);
+        head = (head + len) % CAPACITY;
+        count -= len;
+        return len;
+    }
+
+    ACIA6551::ACIA6551(uint16_t address, arx65::cpu::Cpu *irqTarget, double cpuClockHz)
     {
         base_address = address;
-        command_register = 0x02;
+        cpu = irqTarget;
+        irqSource = cpu ? cpu->allocateInterruptSource() : 0;
+        cpuHz = cpuClockHz;
+        unthrottled = false;
+        carrier = dataSetReady = true;
+        command_register = COMMAND_IRQ_DISABLE;
         control_register = 0x00;
+        status_register = 0x00;
+        receiveData = transmitData = shifting = 0;
+        receiveFull = transmitFull = shifterBusy = receiving = false;
+        receiveEvent = transmitEvent = 0;
     }
 
     bool ACIA6551::isAddressInRange(uint16_t addr, bool read)
@@ -18,19 +115,25 @@ namespace arx65::mod
     uint8_t ACIA6551::read(uint16_t address)
     {
         if (address == base_address)
-        {   // Read received data
-            if (receive.size())
-            {
-                uint8_t x = receive.at(0);
-                receive.erase(receive.begin());
-                return x;
-            }
-            return 0x00;
+        {   // Read received data, which makes room for the next byte
+            uint8_t x = receiveData;
+            receiveFull = false;
+            status_register &= ~STATUS_OVERRUN;
+            pumpReceive();
+            return x;
         }
         else if (address == base_address + 1)
-        {   // Read status register (all can stay as 0 except read?)
-            // Transmit empty should also be 1 so processor can send
-            return (receive.size() > 0 ? 0x18 : 0x10);
+        {   // Read status register, the data register bits come from the data registers
+            uint8_t status = (status_register & (STATUS_IRQ | STATUS_OVERRUN))
+                | (receiveFull ? STATUS_RECEIVE_FULL : 0)
+                | (transmitFull ? 0 : STATUS_TRANSMIT_EMPTY)
+                | (carrier ? 0 : STATUS_NO_CARRIER)
+                | (dataSetReady ? 0 : STATUS_NOT_READY);
+
+            // Reading the status acknowledges the interrupt
+            status_register &= ~STATUS_IRQ;
+            if (cpu) cpu->deassertIRQ(irqSource);
+            return status;
         }
         else if (address == base_address + 2)
         {   // Read command register
@@ -47,26 +150,141 @@ namespace arx65::mod
     {
         if (address == base_address)
         {   // Send transmitted data
-            // Only do something if DTR is active (transmit/receive enable)
-            if (control_register & 0x01) transmit.push_back(byte);
+            // Only do something if DTR is active (transmit/receive enable). A byte written while the
+            // transmit data register is not empty is lost.
+            if (!(command_register & COMMAND_DTR) || transmitFull) return;
+            transmitData = byte;
+            transmitFull = true;
+            pumpTransmit();
         }
         else if (address == base_address + 1)
-        {   // Programmed reset (data doesn't care)
+        {   // Programmed reset (data doesn't care). Frames on the line are dropped with the FIFOs.
+            if (receiving) cpu->getScheduler()->cancel(receiveEvent);
+            if (shifterBusy) cpu->getScheduler()->cancel(transmitEvent);
+            receiving = shifterBusy = false;
             transmit.clear();
             receive.clear();
+            receiveFull = transmitFull = false;
+            status_register &= ~(STATUS_IRQ | STATUS_OVERRUN);
+            if (cpu) cpu->deassertIRQ(irqSource);
             command_register |= 0x02;
             command_register &= 0xE2;
         }
         else if (address == base_address + 2)
-        {   // Write to command register
+        {   // Write to command register. Raising DTR lets queued bytes in.
             command_register = byte;
+            pumpReceive();
+            pumpTransmit();
         }
         else if (address == base_address + 3)
-        {   // Write to control register - DONE
+        {   // Write to control register, baud rate and word format, which the next frame goes at
             control_register = byte;
+            pumpReceive();
+            pumpTransmit();
         }
     }
 
+    void ACIA6551::setUnthrottled(bool enable)
+    {
+        unthrottled = enable;
+        pumpReceive();
+        pumpTransmit();
+    }
+
+    void ACIA6551::setCpuClock(double hz)
+    {
+        cpuHz = hz;
+    }
+
+    void ACIA6551::setCarrier(bool detected)
+    {
+        carrier = detected;
+    }
+
+    void ACIA6551::setDataSetReady(bool ready)
+    {
+        dataSetReady = ready;
+    }
+
+    long ACIA6551::frameCycles()
+    {
+        double baud = BAUD_RATES[control_register & 0x0F];
+        if (unthrottled || !cpu || baud == 0) return 0;
+
+        // Start bit, 8 to 5 data bits, parity if enabled, then 1 or 2 stop bits
+        int bits = 1 + (8 - ((control_register >> 5) & 0x03)) + (command_register & COMMAND_PARITY ? 1 : 0) + (control_register & 0x80 ? 2 : 1);
+        return std::max(1L, std::lround(bits * cpuHz / baud));
+    }
+
+    void ACIA6551::pumpReceive()
+    {
+        if (receiving || receive.empty() || !(command_register & COMMAND_DTR)) return;
+
+        long cycles = frameCycles();
+        if (cycles == 0)
+        {
+            // Nothing to wait for, the next byte is in the data register as soon as it is free
+            if (!receiveFull) receiveByte(receive.pop());
+            return;
+        }
+
+        // The byte is on the line now and can not be held back, it overruns if still not read
+        uint8_t byte = receive.pop();
+        receiving = true;
+        receiveEvent = cpu->getScheduler()->schedule(cpu->getCycles() + cycles, [this, byte](uint64_t) {
+            receiving = false;
+            receiveByte(byte);
+            pumpReceive();
+        });
+    }
+
+    void ACIA6551::pumpTransmit()
+    {
+        if (!transmitFull || shifterBusy) return;
+
+        long cycles = frameCycles();
+        if (cycles == 0)
+        {
+            // Held in the data register while the host is behind, which clears TDRE
+            if (transmit.push(transmitData)) transmitFull = false;
+            return;
+        }
+
+        shifting = transmitData;
+        transmitFull = false;
+        shifterBusy = true;
+
+        transmitEvent = cpu->getScheduler()->schedule(cpu->getCycles() + cycles, [this](uint64_t now) { shiftOut(now); });
+    }
+
+    void ACIA6551::shiftOut(uint64_t now)
+    {
+        // Try again a frame later while the host is behind, rather than lose the byte
+        if (!transmit.push(shifting))
+        {
+            transmitEvent = cpu->getScheduler()->schedule(now + std::max(1L, frameCycles()), [this](uint64_t now) { shiftOut(now); });
+            return;
+        }
+        shifterBusy = false;
+        pumpTransmit();
+    }
+
+    void ACIA6551::receiveByte(uint8_t byte)
+    {
+        if (receiveFull)
+        {
+            status_register |= STATUS_OVERRUN;
+            return;
+        }
+        receiveData = byte;
+        receiveFull = true;
+
+        // Echo mode sends what arrives straight back
+        if ((command_register & 0x1C) == COMMAND_ECHO) transmit.push(byte);
+
+        receiveInterrupt();
+    }
+
     int ACIA6551::bytesAvailable()
     {
         return transmit.size();
@@ -74,40 +292,55 @@ namespace arx65::mod
 
     uint8_t ACIA6551::nextByte()
     {
-        uint8_t x = transmit.at(0);
-        transmit.erase(transmit.begin());
+        uint8_t x = transmit.pop();
+        pumpTransmit();
         return x;
     }
 
     void ACIA6551::clearBytes()
     {
         transmit.clear();
+        pumpTransmit();
     }
 
-    void ACIA6551::sendByte(const uint8_t byte)
+    int ACIA6551::drainBytes(uint8_t *buffer, int len)
     {
-        // Only do something if DTR is active (transmit/receive enable)
-        if (control_register & 0x01)
-        {
-            // TODO: Call IRQ of CPU if IRQ enabled
-            if (0x02 & control_register) {
-                status_register |= 0x80;
-                arx65::cpu::doIRQ();
-            }
+        int count = transmit.pop(buffer, len);
+        pumpTransmit();
+        return count;
+    }
 
-            // Push the byte to be received
-            receive.push_back(byte);
+    bool ACIA6551::sendByte(const uint8_t byte)
+    {
+        // Only do something if DTR is active (transmit/receive enable)
+        if (!(command_register & COMMAND_DTR)) return false;
 
-            // If echo enabled, then echo
-            if (0x10 & control_register) transmit.push_back(byte);
+        // Push the byte to be received
+        if (!receive.push(byte))
+        {
+            status_register |= STATUS_OVERRUN;
+            return false;
         }
+        pumpReceive();
+        return true;
     }
 
-    void ACIA6551::sendBytes(const uint8_t *byte, int len)
+    void ACIA6551::receiveInterrupt()
     {
-        for (int i = 0; byte[i] != '\0' && (len < 0 || i < len); i++)
-        {
-            sendByte(byte[i]);
+        // Hold IRQ until the processor reads the status register
+        if (!(command_register & COMMAND_IRQ_DISABLE)) {
+            status_register |= STATUS_IRQ;
+            if (cpu) cpu->assertIRQ(irqSource);
         }
     }
-}
\ No newline at end of file
+
+    int ACIA6551::sendBytes(const uint8_t *byte, int len)
+    {
+        if (!(command_register & COMMAND_DTR)) return 0;
+
+        if (len < 0) len = strlen((const char *)byte);
+        int taken = receive.push(byte, len);
+        pumpReceive();
+        return taken;
+    }
+}
@@ -46,12 +46,12 @@ namespace arx65::mod
 			return false;
 		}
 
-		std::cout << "Memory file '" << filename << "' found, " << romLength << " bytes long.\r\n";
+		std::clog << "Memory file '" << filename << "' found, " << romLength << " bytes long.\r\n";
 		
 		romFile.read((char *)(data_start + addressStart - start_addr), romLength);
 		romFile.close();
 		
-		std::cout << "Finished loading memory file '" << filename << "' at 0x" << HEX(4, addressStart) << ".\r\n";
+		std::clog << "Finished loading memory file '" << filename << "' at 0x" << HEX(4, addressStart) << ".\r\n";
 		return true;
 	}
 
@@ -92,4 +92,13 @@ namespace arx65::mod
 			data_start[address - start_addr] = byte;
 		}
 	}
+
+	bool SimpleMemory::getMemorySpan(MemorySpan &span)
+	{
+		span.start = start_addr;
+		span.end = end_addr;
+		span.data = data_start;
+		span.writable = !isReadOnlyMemory;
+		return true;
+	}
 }
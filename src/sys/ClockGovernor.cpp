@@ -0,0 +1,118 @@
+#include "sys/ClockGovernor.h"
+
+using namespace std;
+
+namespace arx65::sys
+{
+    ClockGovernor::ClockGovernor(double mhz)
+    {
+        slipped = Clock::duration::zero();
+        turbo = false;
+        setSpeed(mhz);
+    }
+
+    void ClockGovernor::setSpeed(double mhz)
+    {
+        hz = mhz > 0 ? mhz * 1000000 : 0;
+        restart();
+    }
+
+    void ClockGovernor::restart()
+    {
+        origin = Clock::now();
+        cycles = 0;
+
+        reportStart = origin;
+        reportCycles = 0;
+        reportSlipped = slipped;
+    }
+
+    double ClockGovernor::getSpeed()
+    {
+        return hz / 1000000;
+    }
+
+    bool ClockGovernor::isUnlimited()
+    {
+        return hz == 0;
+    }
+
+    void ClockGovernor::setTurbo(bool on)
+    {
+        if (on == turbo) return;
+        turbo = on;
+
+        // Forget the time run ahead, and start a fresh report so the multiplier covers turbo only
+        restart();
+    }
+
+    bool ClockGovernor::isTurbo()
+    {
+        return turbo;
+    }
+
+    ClockGovernor::Clock::duration ClockGovernor::emulatedTime()
+    {
+        return chrono::duration_cast<Clock::duration>(chrono::duration<double>(cycles / hz));
+    }
+
+    long ClockGovernor::cyclesUntil(Clock::time_point deadline)
+    {
+        if (isUnlimited() || turbo) return 0;
+
+        // Give up whatever the machine can not catch up on, so a stall is not followed by a burst
+        // far above the target speed
+        Clock::duration lag = Clock::now() - (origin + emulatedTime());
+        if (lag > MAX_LAG)
+        {
+            origin += lag - MAX_LAG;
+            slipped += lag - MAX_LAG;
+        }
+
+        double due = chrono::duration<double>(deadline - origin).count() * hz - cycles;
+        return due > 0 ? (long)ceil(due) : 0;
+    }
+
+    void ClockGovernor::account(long used)
+    {
+        cycles += used;
+        reportCycles += used;
+    }
+
+    void ClockGovernor::sleepUntil(Clock::time_point deadline)
+    {
+        this_thread::sleep_until(deadline);
+    }
+
+    ClockGovernor::Clock::duration ClockGovernor::getDrift()
+    {
+        if (isUnlimited() || turbo) return Clock::duration::zero();
+        return (origin + emulatedTime()) - Clock::now();
+    }
+
+    string ClockGovernor::report()
+    {
+        Clock::time_point now = Clock::now();
+        double seconds = chrono::duration<double>(now - reportStart).count();
+        double mhz = seconds > 0 ? reportCycles / seconds / 1000000 : 0;
+
+        stringstream out;
+        out << fixed << setprecision(3) << mhz << " MHz";
+        if (turbo && !isUnlimited())
+        {
+            out << ", turbo x" << setprecision(1) << mhz * 1000000 / hz;
+        }
+        else if (!isUnlimited())
+        {
+            out << " (" << setprecision(0) << mhz * 1000000 / hz * 100 << "%)"
+                << ", drift " << setprecision(2) << chrono::duration<double, milli>(getDrift()).count() << " ms";
+            if (slipped != reportSlipped)
+                out << ", lost " << chrono::duration<double, milli>(slipped - reportSlipped).count() << " ms";
+        }
+
+        reportStart = now;
+        reportCycles = 0;
+        reportSlipped = slipped;
+        return out.str();
+    }
+}
@@ -0,0 +1,93 @@
+#include "sys/EmulationThread.h"
+
+using namespace std;
+
+namespace arx65::sys
+{
+    // Cycles handed to the system per tick, so clock reads are paid per batch
+    const long CYCLES_PER_TICK = 10000;
+
+    // Larger batches for turbo, where only the slice deadline matters
+    const long TURBO_CYCLES_PER_TICK = 1000000;
+
+    // Host time between the points where the thread catches up with the clock and sleeps. Also how
+    // long input and turbo changes may wait to be noticed.
+    const chrono::milliseconds SLICE(4);
+
+    // How often the effective speed and drift are reported
+    const chrono::seconds REPORT_INTERVAL(1);
+
+    EmulationThread::EmulationThread(ISystem *system, double mhz) : governor(mhz)
+    {
+        this->system = system;
+        running = false;
+    }
+
+    EmulationThread::~EmulationThread()
+    {
+        stop();
+    }
+
+    void EmulationThread::start()
+    {
+        if (running) return;
+        running = true;
+        thread = std::thread(&EmulationThread::run, this);
+    }
+
+    void EmulationThread::stop()
+    {
+        running = false;
+        if (thread.joinable()) thread.join();
+    }
+
+    bool EmulationThread::nextReport(string &report)
+    {
+        bool any = false;
+        while (reports.pop(report)) any = true;
+        return any;
+    }
+
+    void EmulationThread::run()
+    {
+        auto deadline = ClockGovernor::Clock::now();
+        auto nextReport = deadline + REPORT_INTERVAL;
+
+        while (running)
+        {
+            // Slices the host could not keep up with are skipped, the governor accounts for the lag
+            auto now = ClockGovernor::Clock::now();
+            while (deadline <= now) deadline += SLICE;
+
+            governor.setTurbo(system->isTurbo());
+            if (governor.isTurbo())
+            {
+                do governor.account(system->tick(TURBO_CYCLES_PER_TICK));
+                while (ClockGovernor::Clock::now() < deadline);
+            }
+            else if (governor.isUnlimited())
+            {
+                do governor.account(system->tick(CYCLES_PER_TICK));
+                while (ClockGovernor::Clock::now() < deadline);
+            }
+            else
+            {
+                long due = governor.cyclesUntil(deadline);
+                while (due > 0)
+                {
+                    long used = system->tick(min(due, CYCLES_PER_TICK));
+                    if (used <= 0) break;
+                    governor.account(used);
+                    due -= used;
+                }
+                governor.sleepUntil(deadline);
+            }
+
+            if (deadline >= nextReport)
+            {
+                reports.push(governor.report());
+                nextReport = deadline + REPORT_INTERVAL;
+            }
+        }
+    }
+}
@@ -4,8 +4,9 @@ namespace arx65::sys
 {
     void ISystem::init(){}
     void ISystem::deinit(){}
-    void ISystem::tick(double delta){}
+    long ISystem::tick(long cycleBudget){ return 0; }
     void ISystem::drawGraphics(SDL_Renderer *renderer, double delta){}
+    bool ISystem::isTurbo(){ return false; }
     void ISystem::keyPressEvent(SDL_Keysym k){}
     void ISystem::keyReleaseEvent(SDL_Keysym k){}
     void ISystem::keyTypeEvent(char *text){}
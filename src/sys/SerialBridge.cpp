@@ -0,0 +1,380 @@
+#include "sys/SerialBridge.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+using arx65::mod::ACIA6551;
+
+namespace arx65::sys
+{
+    // Largest single read or write on the host side
+    const size_t CHUNK = 4096;
+
+    // How often host ends epoll can not watch are tried, in milliseconds
+    const int POLL_INTERVAL = 2;
+
+    // How long close() waits for the host to take the last output
+    const chrono::seconds DRAIN_TIMEOUT(1);
+
+    // A descriptor of our own for stdin or stdout that can be non-blocking. Setting O_NONBLOCK on
+    // the descriptor itself would change the open file it shares with stderr on a terminal, and
+    // diagnostics written there could fail with EAGAIN. A terminal or pipe is opened again through
+    // /proc, which gives a new open file. Regular files never block and are only duplicated.
+    static int openStdio(int fd, int access)
+    {
+        struct stat info;
+        if (fstat(fd, &info) == 0 && !S_ISREG(info.st_mode))
+        {
+            string path = "/proc/self/fd/" + to_string(fd);
+            int own = ::open(path.c_str(), access | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+            if (own >= 0) return own;
+        }
+        return fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    }
+
+    SerialBridge::SerialBridge(ACIA6551 *acia)
+    {
+        this->acia = acia;
+        mode = BRIDGE_STDIO;
+        inFd = outFd = listenFd = slaveFd = epollFd = wakeFd = -1;
+        inPolled = outPolled = true;
+        inputDone = false;
+        running = false;
+        connected = false;
+        pendingOffset = 0;
+        inputCount = inputOffset = 0;
+    }
+
+    SerialBridge::~SerialBridge()
+    {
+        close();
+    }
+
+    bool SerialBridge::open(BridgeMode mode, const string &path)
+    {
+        close();
+        this->mode = mode;
+
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epollFd < 0 || wakeFd < 0)
+        {
+            cerr << "Serial bridge: could not create epoll: " << strerror(errno) << endl;
+            close();
+            return false;
+        }
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = wakeFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+
+        if (mode == BRIDGE_PTY)
+        {
+            int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+            if (master < 0 || grantpt(master) || unlockpt(master))
+            {
+                cerr << "Serial bridge: could not open a pseudo-terminal: " << strerror(errno) << endl;
+                if (master >= 0) ::close(master);
+                close();
+                return false;
+            }
+            name = ptsname(master);
+
+            // Hold the slave open so the master never sees a hangup between clients, and make it raw
+            // so every byte goes through untouched
+            slaveFd = ::open(name.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+            termios attributes;
+            if (slaveFd >= 0 && tcgetattr(slaveFd, &attributes) == 0)
+            {
+                cfmakeraw(&attributes);
+                tcsetattr(slaveFd, TCSANOW, &attributes);
+            }
+
+            inFd = outFd = master;
+            watch(master, inPolled);
+            outPolled = inPolled;
+            connected = true;
+        }
+        else if (mode == BRIDGE_SOCKET)
+        {
+            sockaddr_un address = {};
+            address.sun_family = AF_UNIX;
+            if (path.empty() || path.size() >= sizeof(address.sun_path))
+            {
+                cerr << "Serial bridge: bad socket path '" << path << "'" << endl;
+                close();
+                return false;
+            }
+            strcpy(address.sun_path, path.c_str());
+            unlink(path.c_str());
+
+            listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (listenFd < 0 || bind(listenFd, (sockaddr *)&address, sizeof(address)) || listen(listenFd, 1))
+            {
+                cerr << "Serial bridge: could not listen on '" << path << "': " << strerror(errno) << endl;
+                close();
+                return false;
+            }
+            name = path;
+
+            event.events = EPOLLIN;
+            event.data.fd = listenFd;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+            connected = false;
+        }
+        else
+        {
+            name = "stdio";
+            inFd = openStdio(STDIN_FILENO, O_RDONLY);
+            outFd = openStdio(STDOUT_FILENO, O_WRONLY);
+            if (inFd < 0 || outFd < 0)
+            {
+                cerr << "Serial bridge: could not open stdio: " << strerror(errno) << endl;
+                close();
+                return false;
+            }
+            watch(inFd, inPolled);
+            watch(outFd, outPolled);
+            connected = true;
+        }
+
+        running = true;
+        thread = std::thread(&SerialBridge::run, this);
+        return true;
+    }
+
+    void SerialBridge::close()
+    {
+        if (running)
+        {
+            drainUntil = chrono::steady_clock::now() + DRAIN_TIMEOUT;
+            running = false;
+            wake();
+            thread.join();
+        }
+
+        if (inFd >= 0) ::close(inFd);
+        if (outFd >= 0 && outFd != inFd) ::close(outFd);
+        if (listenFd >= 0)
+        {
+            ::close(listenFd);
+            unlink(name.c_str());
+        }
+        if (slaveFd >= 0) ::close(slaveFd);
+        if (epollFd >= 0) ::close(epollFd);
+        if (wakeFd >= 0) ::close(wakeFd);
+
+        inFd = outFd = listenFd = slaveFd = epollFd = wakeFd = -1;
+        inputDone = false;
+        connected = false;
+        pendingOutput.clear();
+        pendingOffset = 0;
+    }
+
+    string SerialBridge::getName()
+    {
+        return name;
+    }
+
+    void SerialBridge::wake()
+    {
+        uint64_t one = 1;
+        if (wakeFd >= 0 && write(wakeFd, &one, sizeof(one)) < 0) {}
+    }
+
+    void SerialBridge::watch(int fd, bool &polled)
+    {
+        epoll_event event = {};
+        event.data.fd = fd;
+        polled = epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+    }
+
+    // Only ask for input while there is room for it and for output while there is some, so a full
+    // queue or an idle line never wakes the thread
+    void SerialBridge::updateInterest()
+    {
+        uint32_t in = inFd >= 0 && !inputDone && toDevice.space() ? (uint32_t)EPOLLIN : 0;
+        uint32_t out = outFd >= 0 && pendingOffset < pendingOutput.size() ? (uint32_t)EPOLLOUT : 0;
+
+        epoll_event event = {};
+        if (inFd == outFd)
+        {
+            if (inFd < 0 || !inPolled) return;
+            event.events = in | out;
+            event.data.fd = inFd;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, inFd, &event);
+            return;
+        }
+        if (inFd >= 0 && inPolled)
+        {
+            event.events = in;
+            event.data.fd = inFd;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, inFd, &event);
+        }
+        if (outFd >= 0 && outPolled)
+        {
+            event.events = out;
+            event.data.fd = outFd;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, outFd, &event);
+        }
+    }
+
+    void SerialBridge::acceptClient()
+    {
+        int client = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client < 0) return;
+
+        // One at a time, the line is busy
+        if (inFd >= 0)
+        {
+            ::close(client);
+            return;
+        }
+        inFd = outFd = client;
+        watch(client, inPolled);
+        outPolled = inPolled;
+        connected = true;
+    }
+
+    void SerialBridge::dropClient(bool input)
+    {
+        if (mode == BRIDGE_SOCKET || (inFd >= 0 && inFd == outFd))
+        {
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, inFd, nullptr);
+            ::close(inFd);
+            inFd = outFd = -1;
+            connected = false;
+
+            // A partly written chunk was meant for the client that left
+            pendingOutput.clear();
+            pendingOffset = 0;
+        }
+        else if (input)
+        {
+            // stdin failed, output still goes on
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, inFd, nullptr);
+            ::close(inFd);
+            inFd = -1;
+        }
+        else
+        {
+            // Nobody reads stdout any more, output is held back from now on
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, outFd, nullptr);
+            ::close(outFd);
+            outFd = -1;
+        }
+    }
+
+    // False when the host end is gone
+    bool SerialBridge::readHost()
+    {
+        uint8_t buffer[CHUNK];
+        while (inFd >= 0 && !inputDone)
+        {
+            size_t room = min(toDevice.space(), CHUNK);
+            if (room == 0) return true;
+
+            ssize_t count = read(inFd, buffer, room);
+            if (count > 0)
+            {
+                for (ssize_t i = 0; i < count; i++) toDevice.push(buffer[i]);
+                continue;
+            }
+            if (count == 0)
+            {
+                if (mode == BRIDGE_SOCKET) return false;
+                inputDone = true;
+                return true;
+            }
+            // EIO is a pty with no other end open, which is not an error for us
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == EIO;
+        }
+        return true;
+    }
+
+    bool SerialBridge::writeHost()
+    {
+        while (outFd >= 0)
+        {
+            if (pendingOffset == pendingOutput.size())
+            {
+                pendingOutput.clear();
+                pendingOffset = 0;
+                uint8_t byte;
+                while (pendingOutput.size() < CHUNK && fromDevice.pop(byte)) pendingOutput.push_back(byte);
+                if (pendingOutput.empty()) return true;
+            }
+
+            ssize_t count = write(outFd, pendingOutput.data() + pendingOffset, pendingOutput.size() - pendingOffset);
+            if (count > 0)
+            {
+                pendingOffset += count;
+                continue;
+            }
+            // EIO is a pty with no other end open, as when reading
+            return count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == EIO);
+        }
+        return true;
+    }
+
+    void SerialBridge::run()
+    {
+        epoll_event events[4];
+        while (running || (outFd >= 0 && (pendingOffset < pendingOutput.size() || !fromDevice.empty())
+            && chrono::steady_clock::now() < drainUntil))
+        {
+            updateInterest();
+
+            bool polling = !running || (inFd >= 0 && !inPolled && !inputDone) || (outFd >= 0 && !outPolled);
+            int count = epoll_wait(epollFd, events, 4, polling ? POLL_INTERVAL : -1);
+
+            for (int i = 0; i < count; i++)
+            {
+                if (events[i].data.fd == wakeFd)
+                {
+                    uint64_t value;
+                    if (read(wakeFd, &value, sizeof(value)) < 0) {}
+                }
+                else if (events[i].data.fd == listenFd)
+                {
+                    acceptClient();
+                }
+            }
+
+            // Both directions are non-blocking, so just try them on every wakeup
+            if (!readHost()) dropClient(true);
+            if (!writeHost()) dropClient(false);
+        }
+    }
+
+    void SerialBridge::service()
+    {
+        acia->setCarrier(connected);
+        bool moved = false;
+
+        // Host to chip. What the chip has no room for, or takes nothing of while DTR is off, waits
+        // here and then in the queue, until the I/O thread stops reading the host.
+        if (inputOffset == inputCount)
+        {
+            inputCount = inputOffset = 0;
+            while (inputCount < (int)sizeof(pendingInput) && toDevice.pop(pendingInput[inputCount])) inputCount++;
+            moved = inputCount > 0;
+        }
+        inputOffset += acia->sendBytes(pendingInput + inputOffset, inputCount - inputOffset);
+
+        // Chip to host. While the queue is full, bytes stay in the ACIA and TDRE clears.
+        uint8_t buffer[CHUNK];
+        int count = acia->drainBytes(buffer, min(fromDevice.space(), CHUNK));
+        for (int i = 0; i < count; i++) fromDevice.push(buffer[i]);
+        moved |= count > 0;
+
+        if (moved) wake();
+    }
+}
@@ -12,7 +12,7 @@ using namespace std;
 namespace arx65::sys
 {
     /** This is specifically a debug view terminal. */
-    Terminal::Terminal(int sWidth, int sHeight)
+    Terminal::Terminal(int sWidth, int sHeight, double clockMHz)
     {
         screen_width = sWidth;
         screen_height = sHeight;
@@ -20,6 +20,7 @@ namespace arx65::sys
         cursor_column = 0;
 
         freerun = false;
+        freerunLatched = false;
 
         text_buffer.push_back("");
         nextEntry = "";
@@ -36,20 +37,27 @@ namespace arx65::sys
         uint8_t vects[] = {PROG_START & 0x00FF, (PROG_START >> 8), PROG_START & 0x00FF, (PROG_START >> 8), PROG_START & 0x00FF, (PROG_START >> 8)};
         progRAM->copyFromMemory(vects, 0xFFFA, 6);
 
+        bus = new arx65::bus::Bus();
+        cpu = new arx65::cpu::Cpu(bus);
+
         // Input/Output chip (we use this to get screen info)
-        acia = new ACIA6551(0x7F70);
+        acia = new ACIA6551(0x7F70, cpu);
+        acia->setCpuClock(clockMHz > 0 ? clockMHz * 1000000 : 1000000);
 
-        bus::attach(acia);
-        bus::attach(progRAM);
+        bus->attach(acia);
+        bus->attach(progRAM);
 
-        cpu::init();
+        cpu->init();
+        normalCore = cpu->getCore();
 
-        cpu::getRegisters()->PC = PROG_START;
+        cpu->getRegisters()->PC = PROG_START;
     }
 
     Terminal::~Terminal()
     {
-        bus::clear();
+        bus->clear();
+        delete cpu;
+        delete bus;
         delete progRAM;
         delete acia;
     }
@@ -64,17 +72,37 @@ namespace arx65::sys
     }
 
     /* Use this for processor control only */
-    void Terminal::tick(double delta)
+    long Terminal::tick(long cycleBudget)
+    {
+        // Switch cores only here, between batches
+        arx65::cpu::Core core = isTurbo() ? arx65::cpu::CORE_JIT : normalCore;
+        if (cpu->getCore() != core) cpu->setCore(core);
+
+        uint8_t byte;
+        while (input.pop(byte)) acia->sendByte(byte);
+
+        long cycles = cpu->runCycles(cycleBudget);
+
+        // Output is collected every batch, since frames are skipped in turbo
+        uint8_t chunk[256];
+        int count;
+        while ((count = acia->drainBytes(chunk, std::min(output.space(), sizeof(chunk)))) > 0)
+        {
+            for (int i = 0; i < count; i++) output.push(chunk[i]);
+        }
+
+        return cycles;
+    }
+
+    bool Terminal::isTurbo()
     {
-        cpu::doNextInstruction();
+        return freerun || freerunLatched;
     }
 
     void Terminal::drawGraphics(SDL_Renderer *r, double delta)
     {
-        while(acia->bytesAvailable())
-        {
-            addToScreenBuffer(acia->nextByte());
-        }
+        uint8_t byte;
+        while (output.pop(byte)) addToScreenBuffer(byte);
 
         SDL_Rect screen;
         SDL_RenderGetViewport(r, &screen);
@@ -127,7 +155,7 @@ namespace arx65::sys
         //if (k.sym == SDLK_BACKSPACE) backspaceScreenBuffer();
         if (k.sym == SDLK_RETURN)
         {
-            acia->sendByte('\n');
+            input.push('\n');
             /*
             nextEntry.push_back('\n');
 
@@ -137,14 +165,14 @@ namespace arx65::sys
             nextEntry = "";
             addToScreenBuffer('\n'); */
         }
-        else if (k.sym == SDLK_RSHIFT)
-        {
-            //for (int i = 0; i < 10; i++) cpu::doNextInstructionDebug();
-        }
         else if (k.sym == SDLK_RCTRL)
         {
             freerun = true;
         }
+        else if (k.sym == SDLK_F12)
+        {
+            freerunLatched = !freerunLatched;
+        }
     }
 
     void Terminal::keyReleaseEvent(SDL_Keysym k)
@@ -159,7 +187,7 @@ namespace arx65::sys
     {
 
         //nextEntry.push_back(text[0]);
-        acia->sendByte(text[0]);
+        input.push(text[0]);
         //addToScreenBuffer(text[0]);
     }
 
@@ -0,0 +1,79 @@
+#include "Processor.h"
+#include "mod/SimpleMemory.h"
+#include "mod/ACIA6551.h"
+
+using namespace std;
+using namespace arx65::cpu;
+using arx65::mod::SimpleMemory;
+using arx65::mod::ACIA6551;
+
+/* A programmed reset of the ACIA while a frame is on the line in either direction. The byte must
+   not arrive afterwards, neither in the receive data register with an IRQ nor at the host. */
+
+const uint16_t ACIA = 0x7F70;
+const uint16_t MAIN = 0x0200;
+const uint16_t HANDLER = 0x0300;
+
+// 9600 baud, 8 data bits, 1 stop bit, and DTR on with the receive interrupt enabled
+const uint8_t CONTROL = 0x1E;
+const uint8_t COMMAND = 0x09;
+
+// One frame is ten bits, about 1042 cycles at 1 MHz
+const long HALF_FRAME = 500;
+const long FRAMES = 5000;
+
+int main()
+{
+    // CLI then spin at MAIN + 1, an interrupt ends up spinning at HANDLER instead
+    uint8_t program[] = {0x58, 0x4C, 0x01, 0x02};
+    uint8_t handler[] = {0x4C, 0x00, 0x03};
+    uint8_t vectors[] = {0x00, 0x02, 0x00, 0x02, 0x00, 0x03};
+
+    SimpleMemory ram(0x0000, 0xFFFF, 0x00, false);
+    ram.copyFromMemory(program, MAIN, sizeof(program));
+    ram.copyFromMemory(handler, HANDLER, sizeof(handler));
+    ram.copyFromMemory(vectors, 0xFFFA, sizeof(vectors));
+
+    arx65::bus::Bus bus;
+    Cpu cpu(&bus);
+    ACIA6551 acia(ACIA, &cpu);
+    bus.attach(&acia);
+    bus.attach(&ram);
+    cpu.init();
+    cpu.doRES();
+
+    bus.write(ACIA + 3, CONTROL);
+    bus.write(ACIA + 2, COMMAND);
+
+    // A byte on its way in and one on its way out, then a reset halfway through both frames
+    acia.sendByte('R');
+    bus.write(ACIA, 'T');
+    cpu.runCycles(HALF_FRAME);
+    bus.write(ACIA + 1, 0x00);
+
+    // The program sets the chip up again, as it would after a reset
+    bus.write(ACIA + 3, CONTROL);
+    bus.write(ACIA + 2, COMMAND);
+    cpu.runCycles(FRAMES);
+
+    bool failed = false;
+    if (cpu.getRegisters()->PC >= HANDLER)
+    {
+        cerr << "FAILED: an IRQ was taken after the reset" << endl;
+        failed = true;
+    }
+    uint8_t status = bus.read(ACIA + 1);
+    if (status & 0x88)
+    {
+        cerr << "FAILED: status $" << HEX(2, status) << " after the reset, a byte was received" << endl;
+        failed = true;
+    }
+    if (acia.bytesAvailable())
+    {
+        cerr << "FAILED: " << acia.bytesAvailable() << " bytes transmitted after the reset" << endl;
+        failed = true;
+    }
+
+    if (!failed) cout << "ACIA reset mid-frame: passed" << endl;
+    return failed ? 1 : 0;
+}